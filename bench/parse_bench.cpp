@@ -0,0 +1,216 @@
+// Parse time and peak heap use of the streaming (SAX) extractors used by
+// album_art.cpp against a plain nlohmann DOM parse of the same responses.
+//
+// Build with -DPARSE_BENCH=ON, then:
+//   ./parse-bench                     all samples in bench/samples/
+//   ./parse-bench -n 500 a.json ...   recorded responses of your own
+//
+// Files named acoustid*.json are read as AcoustID lookups, everything else
+// as MusicBrainz release searches.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+
+#include "json_extract.hpp"
+
+// ── Heap accounting ──
+//
+// Every operator new is counted, and the bytes live at once are tracked so
+// a parse's peak can be measured. Single-threaded, so no atomics.
+
+namespace {
+	size_t liveBytes   = 0;
+	size_t peakBytes   = 0;
+	size_t allocations = 0;
+}
+
+void* operator new(std::size_t size) {
+	void* p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	allocations++;
+	liveBytes += malloc_usable_size(p);
+	peakBytes = std::max(peakBytes, liveBytes);
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	if (!p) return;
+	liveBytes -= malloc_usable_size(p);
+	std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	// Threshold the resolver searches with
+	constexpr double SEARCH_SCORE = 100.0;
+
+	// What each parser extracts, for checking that both agree
+	struct Extracted {
+		std::string              status;
+		std::vector<std::string> releases;
+		std::vector<std::string> groups;
+		double                   score = -1.0;
+
+		bool operator==(const Extracted&) const = default;
+	};
+
+	// ── Streaming: exactly what album_art.cpp runs ──
+
+	Extracted search_sax(const std::string& response) {
+		SearchSax sax(SEARCH_SCORE);
+		Extracted out;
+		if (!sax_extract(response, sax) || sax.bestId.empty()) return out;
+		out.releases.push_back(sax.bestId);
+		if (!sax.bestGroupId.empty()) out.groups.push_back(sax.bestGroupId);
+		out.score = sax.bestScore;
+		return out;
+	}
+
+	Extracted acoustid_sax(const std::string& response) {
+		AcoustIdSax sax;
+		Extracted out;
+		if (!sax_extract(response, sax)) return out;
+		out.status   = sax.status;
+		out.releases = std::move(sax.releaseIds);
+		out.groups   = std::move(sax.releaseGroupIds);
+		return out;
+	}
+
+	// ── DOM: the same fields from a fully built document ──
+
+	Extracted search_dom(const std::string& response) {
+		Extracted out;
+		try {
+			const auto root = nlohmann::json::parse(response);
+			if (!root.contains("releases")) return out;
+			for (const auto& r : root["releases"]) {
+				if (!r.contains("score") || !r.contains("id")) continue;
+				const double score = r["score"];
+				if (score < SEARCH_SCORE || score <= out.score) continue;
+				out.score = score;
+				out.releases = {r["id"].get<std::string>()};
+				out.groups.clear();
+				if (r.contains("release-group") && r["release-group"].contains("id"))
+					out.groups.push_back(r["release-group"]["id"]);
+			}
+		} catch (const std::exception& e) {
+			std::cerr << "DOM parse failed: " << e.what() << '\n';
+		}
+		return out;
+	}
+
+	Extracted acoustid_dom(const std::string& response) {
+		Extracted out;
+		try {
+			const auto root = nlohmann::json::parse(response);
+			out.status = root.value("status", "");
+			if (!root.contains("results") || root["results"].empty()) return out;
+
+			const auto& result = root["results"][0];
+			if (result.contains("releases"))
+				for (const auto& r : result["releases"]) out.releases.push_back(r["id"]);
+			if (result.contains("releasegroups")) {
+				for (const auto& g : result["releasegroups"]) {
+					out.groups.push_back(g["id"]);
+					if (g.contains("releases"))
+						for (const auto& r : g["releases"]) out.releases.push_back(r["id"]);
+				}
+			}
+		} catch (const std::exception& e) {
+			std::cerr << "DOM parse failed: " << e.what() << '\n';
+		}
+		return out;
+	}
+
+	struct Measurement {
+		double us     = 0; // mean wall time per parse
+		size_t allocs = 0; // allocations per parse
+		size_t peak   = 0; // peak bytes above what was live before the parse
+	};
+
+	Measurement measure(const std::function<Extracted(const std::string&)>& parse,
+			const std::string& response, int iterations) {
+		Measurement m;
+
+		// Heap use of one parse, on its own
+		const size_t before = liveBytes, allocsBefore = allocations;
+		peakBytes = liveBytes;
+		parse(response);
+		m.peak   = peakBytes - before;
+		m.allocs = allocations - allocsBefore;
+
+		const auto start = Clock::now();
+		for (int i = 0; i < iterations; ++i) parse(response);
+		m.us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / iterations;
+		return m;
+	}
+
+	std::string read_file(const std::filesystem::path& path) {
+		std::ifstream in(path, std::ios::binary);
+		std::ostringstream ss;
+		ss << in.rdbuf();
+		return ss.str();
+	}
+
+} // anonymous namespace
+
+int main(int argc, char* argv[]) {
+	int iterations = 2000;
+	std::vector<std::filesystem::path> files;
+	for (int i = 1; i < argc; ++i) {
+		const std::string arg = argv[i];
+		if (arg == "-n" && i + 1 < argc) iterations = std::max(1, std::atoi(argv[++i]));
+		else files.emplace_back(arg);
+	}
+	if (files.empty()) {
+		for (const auto& e : std::filesystem::directory_iterator(PARSE_BENCH_SAMPLES))
+			if (e.path().extension() == ".json") files.push_back(e.path());
+		std::sort(files.begin(), files.end());
+	}
+
+	std::printf("%-34s %8s  %-6s %10s %8s %10s\n",
+			"response", "bytes", "parser", "us/parse", "allocs", "peak B");
+
+	int rc = 0;
+	for (const auto& path : files) {
+		const std::string response = read_file(path);
+		if (response.empty()) {
+			std::cerr << "Cannot read " << path << '\n';
+			rc = 1;
+			continue;
+		}
+
+		const bool acoustid = path.filename().string().rfind("acoustid", 0) == 0;
+		auto sax = acoustid ? acoustid_sax : search_sax;
+		auto dom = acoustid ? acoustid_dom : search_dom;
+
+		if (!(sax(response) == dom(response))) {
+			std::cerr << path.filename().string() << ": SAX and DOM extract different fields\n";
+			rc = 1;
+		}
+
+		const std::string name = path.filename().string();
+		for (const auto& [label, parse] : {std::pair{"sax", sax}, std::pair{"dom", dom}}) {
+			const Measurement m = measure(parse, response, iterations);
+			std::printf("%-34s %8zu  %-6s %10.1f %8zu %10zu\n",
+					name.c_str(), response.size(), label, m.us, m.allocs, m.peak);
+		}
+	}
+	return rc;
+}
@@ -1,24 +1,24 @@
 #include "album_art.hpp"
 
 #include <curl/curl.h>
-#include <nlohmann/json.hpp>
+#include <zlib.h>
 
 #include <iostream>
 #include <vector>
 #include <cctype>
-#include <unordered_map>
 #include <string>
+#include <chrono>
+#include <unordered_map>
+#include <algorithm>
 #include "logger.hpp"
+#include "art_cache.hpp"
+#include "http_client.hpp"
+#include "json_extract.hpp"
+#include "lru_cache.hpp"
+#include "single_flight.hpp"
 
 namespace {
 
-	size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* out)
-	{
-		size_t totalSize = size * nmemb;
-		out->append(static_cast<char*>(contents), totalSize);
-		return totalSize;
-	}
-
 	// Optimized URL encoding
 	std::string url_encode(const std::string& input) {
 		static const char* hex = "0123456789ABCDEF";
@@ -38,224 +38,699 @@ namespace {
 		return encoded;
 	}
 
-	// Static curl handle for reuse
-	static CURL* curl = nullptr;
+	// Body of a successful response, or "" after logging the failure
+	std::string response_body(const std::string& url, HttpResponse response) {
+		if (response.result != CURLE_OK) {
+			LOG_ERR("cURL request failed for URL: " << url 
+					<< " - Error: " << curl_easy_strerror(response.result));
+			return {};
+		}
 
-	void init_curl() {
-		if (!curl) {
-			curl = curl_easy_init();
+		// Get response code for debugging
+		LOG_DEBUG("Response code: " << response.status);
+
+		// Throttling / server errors must not be parsed (and cached) as results
+		if (response.status >= 400) {
+			LOG_ERR("HTTP " << response.status << " for URL: " << url);
+			return {};
 		}
+
+		return std::move(response.body);
 	}
 
 	std::string get_response(const std::string& url) {
-		init_curl();
-
-		std::string response;
-		curl_easy_reset(curl);
-		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-		curl_easy_setopt(curl, CURLOPT_USERAGENT, "MPD-Presence");
-		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 5L); // Faster timeout
-
 		LOG_DEBUG("Making request to: " << url);
+		return response_body(url, http_get(url));
+	}
 
-		CURLcode res = curl_easy_perform(curl);
-		if (res != CURLE_OK) {
-			LOG_ERR("cURL request failed for URL: " << url 
-					<< " - Error: " << curl_easy_strerror(res));
+	std::string post_response(const std::string& url, const std::string& body,
+			const std::vector<std::string>& headers) {
+		LOG_DEBUG("Making POST request to: " << url);
+		return response_body(url, http_post(url, body, headers));
+	}
+
+	// gzip-compress a request body. Empty on failure.
+	std::string gzip_compress(const std::string& input) {
+		z_stream zs{};
+		// 15 window bits + 16 selects the gzip wrapper
+		if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+					Z_DEFAULT_STRATEGY) != Z_OK)
 			return {};
+
+		std::string out(deflateBound(&zs, input.size()), '\0');
+		zs.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+		zs.avail_in  = static_cast<uInt>(input.size());
+		zs.next_out  = reinterpret_cast<Bytef*>(out.data());
+		zs.avail_out = static_cast<uInt>(out.size());
+
+		int rc = deflate(&zs, Z_FINISH);
+		out.resize(zs.total_out);
+		deflateEnd(&zs);
+		return rc == Z_STREAM_END ? out : std::string();
+	}
+
+	// ── Cache policy ──
+	//
+	// A lookup either found something, got a definitive "no such thing"
+	// from the server, or failed transiently (network error, throttling,
+	// server error, malformed reply). Each outcome is cached for its own
+	// time; transient failures back off exponentially so a flaky moment
+	// does not disable art for an album until restart.
+
+	using Clock = std::chrono::steady_clock;
+
+	enum class Outcome { Found, NotFound, Transient };
+
+	constexpr auto FOUND_TTL     = std::chrono::hours(6);
+	constexpr auto NOT_FOUND_TTL = std::chrono::hours(1);
+	constexpr auto RETRY_MIN     = std::chrono::seconds(30);
+	constexpr auto RETRY_MAX     = std::chrono::hours(1);
+
+	template <typename T>
+	struct Lookup {
+		T       value{};
+		Outcome outcome = Outcome::Transient;
+	};
+
+	template <typename T>
+	struct Cached {
+		Lookup<T>         lookup;
+		Clock::time_point expires;
+		int               failures = 0; // consecutive transient failures
+	};
+
+	template <typename T>
+	size_t cache_size_of(const Cached<T>& c) {
+		using ::cache_size_of;
+		return sizeof(c) + cache_size_of(c.lookup.value);
+	}
+
+	// 30 s, 1 min, 2 min, ... capped at RETRY_MAX
+	Clock::duration retry_delay(int failures) {
+		const int shift = std::clamp(failures - 1, 0, 7);
+		return std::min<Clock::duration>(RETRY_MIN * (1 << shift), RETRY_MAX);
+	}
+
+	// Live cached lookup, or nullopt when it must be fetched. `failures`
+	// receives the transient failure count so far, for the next backoff.
+	template <typename T>
+	std::optional<Lookup<T>> cache_probe(
+			ShardedLruCache<Cached<T>>& cache, std::string_view key, int& failures)
+	{
+		failures = 0;
+		auto cached = cache.get(key);
+		if (!cached) return std::nullopt;
+		if (cached->lookup.outcome == Outcome::Transient) failures = cached->failures;
+		if (Clock::now() >= cached->expires) return std::nullopt;
+		return std::move(cached->lookup);
+	}
+
+	template <typename T>
+	void cache_store(
+			ShardedLruCache<Cached<T>>& cache, std::string_view key,
+			Lookup<T> lookup, int failures)
+	{
+		Cached<T> entry;
+		switch (lookup.outcome) {
+			case Outcome::Found:
+				entry.expires = Clock::now() + FOUND_TTL;
+				break;
+			case Outcome::NotFound:
+				entry.expires = Clock::now() + NOT_FOUND_TTL;
+				break;
+			case Outcome::Transient: {
+				entry.failures = failures + 1;
+				const auto delay = retry_delay(entry.failures);
+				entry.expires = Clock::now() + delay;
+				LOG_DEBUG("Lookup failed for " << key << ", retrying in "
+						<< std::chrono::duration_cast<std::chrono::seconds>(delay).count()
+						<< " s (failure " << entry.failures << ")");
+				break;
+			}
 		}
+		entry.lookup = std::move(lookup);
+		cache.put(key, std::move(entry));
+	}
 
-		// Get response code for debugging
-		long response_code = 0;
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-		LOG_DEBUG("Response code: " << response_code);
+	// Releases matching a lookup (best first) and their release groups
+	struct Candidates {
+		std::vector<std::string> releases;
+		std::vector<std::string> groups;
+		double                   score = 0.0; // search score of releases[0]
+	};
 
-		return response;
+	size_t cache_size_of(const Candidates& c) {
+		using ::cache_size_of;
+		return cache_size_of(c.releases) + cache_size_of(c.groups);
 	}
 
+	// AcoustID results keyed by fingerprint hash + duration
+	ShardedLruCache<Cached<Candidates>> acoustid_cache(1024, 1 << 20);
+
+	// MusicBrainz returns 25 fully expanded releases by default; we only
+	// ever use the best few
+	constexpr int SEARCH_LIMIT = 5;
+
 	// Simple cache for search results
-	static std::unordered_map<std::string, std::vector<std::pair<std::string, double>>> search_cache;
+	ShardedLruCache<Cached<Candidates>> search_cache(1024, 1 << 20);
+
+	// Cover art existence checks, keyed by release ID (or "rg:" + release
+	// group ID). The value is the image URL the Cover Art Archive redirects
+	// to, so the presence can point Discord straight at it.
+	ShardedLruCache<Cached<std::string>> cover_art_cache(8192);
+
+	// Outcome of a Cover Art Archive check shared with coalesced waiters.
+	// Failed = transient error (already cached with backoff by the leader).
+	// Abandoned = the leader gave up (deadline, cancelled); waiters retry.
+	enum class CoverCheck { Exists, Missing, Failed, Abandoned };
+
+	// Cover Art Archive serves art per release and per release group
+	enum class CoverOf { Release, ReleaseGroup };
+
+	// In-flight lookups, so concurrent callers (current track, prefetch)
+	// asking for the same thing attach to one request
+	// Search and AcoustID flights publish nullopt when the leader was
+	// abandoned (see shared_lookup)
+	SingleFlight<CoverCheck>                         cover_flight;
+	SingleFlight<std::optional<Lookup<Candidates>>>  acoustid_flight;
+	SingleFlight<std::optional<Lookup<Candidates>>>  search_flight;
+
+	// Run fetch() as the flight for `key` and cache its outcome. A leader
+	// that was cancelled or ran out of time caches nothing and hands its
+	// waiters nullopt, so they look it up themselves instead of inheriting
+	// a failure they did not cause (as Cover Art Archive checks do).
+	template <typename F>
+	Lookup<Candidates> shared_lookup(
+			SingleFlight<std::optional<Lookup<Candidates>>>& flight,
+			ShardedLruCache<Cached<Candidates>>& cache,
+			const std::string& key, int failures, F&& fetch)
+	{
+		while (true) {
+			bool               led = false;
+			Lookup<Candidates> own;
+			auto shared = flight.run(key, [&]() -> std::optional<Lookup<Candidates>> {
+				led = true;
+				own = fetch();
+				if (http_abandoned()) return std::nullopt;
+				cache_store(cache, key, own, failures);
+				return own;
+			});
+			if (led) return own;
+			if (shared) return std::move(*shared);
+			if (http_abandoned()) return {};
+
+			LOG_DEBUG("Shared lookup for " << key << " was abandoned, retrying");
+			if (auto cached = cache_probe(cache, key, failures)) return std::move(*cached);
+		}
+	}
 
-	// Cache for cover art existence checks
-	static std::unordered_map<std::string, bool> cover_art_cache;
+	// A release (or release group) with art, and its image URL
+	struct CoverArt {
+		std::string id;
+		CoverOf     kind = CoverOf::Release;
+		std::string image;
+	};
+
+	// Build the search cache key in a reused per-thread buffer, so probing
+	// the cache does not allocate
+	std::string_view search_cache_key(
+			const std::string& artist,
+			const std::string& album,
+			const std::string& date)
+	{
+		thread_local std::string key;
+		key.assign("mb:").append(artist).append(1, ':')
+			.append(album).append(1, ':').append(date);
+		return key;
+	}
 
 } // anonymous namespace
 
 // MusicBrainz search with caching
-std::vector<std::pair<std::string, double>> json_get_release_ids_search(
+// Cache miss path of search_release_ids()
+static Lookup<Candidates> fetch_release_ids_search(
 		const std::string& artist,
 		const std::string& album,
 		const std::string& date,
 		double scoreThreshold)
 {
-	std::string cache_key = "mb:" + artist + ":" + album + ":" + date;
-
-	// Check if result is cached
-	auto cached = search_cache.find(cache_key);
-	if (cached != search_cache.end()) {
-		LOG_DEBUG("Using cached MusicBrainz results for: " << cache_key);
-		return cached->second;
-	}
-
 	std::string url =
 		"https://musicbrainz.org/ws/2/release/?query=artist:" +
 		url_encode(artist) + "%20release:" +
 		url_encode(album) + "%20date:" +
-		url_encode(date) + "&fmt=json";
+		url_encode(date) + "&fmt=json&limit=" + std::to_string(SEARCH_LIMIT);
+
+	Lookup<Candidates> result;
 
 	std::string response = get_response(url);
 	if (response.empty()) {
 		LOG_ERR("Empty response from MusicBrainz for: " << url);
-		return {};
+		return result;
+	}
+
+	// Find the release with the highest score above the threshold
+	SearchSax sax(scoreThreshold);
+	if (!sax_extract(response, sax)) return result;
+
+	if (!sax.bestId.empty()) {
+		result.value.releases.push_back(sax.bestId);
+		if (!sax.bestGroupId.empty()) result.value.groups.push_back(sax.bestGroupId);
+		result.value.score = sax.bestScore;
+		result.outcome = Outcome::Found;
+		LOG_DEBUG("Found best match with ID: " << sax.bestId 
+				<< " and score: " << sax.bestScore);
+	} else {
+		result.outcome = Outcome::NotFound;
+		LOG_DEBUG("No valid matches found above threshold");
+	}
+	return result;
+}
+
+static Lookup<Candidates> search_release_ids(
+		const std::string& artist,
+		const std::string& album,
+		const std::string& date,
+		double scoreThreshold)
+{
+	// Check if result is cached, probing with the per-thread key buffer
+	int failures = 0;
+	const std::string_view probe_key = search_cache_key(artist, album, date);
+	if (auto cached = cache_probe(search_cache, probe_key, failures)) {
+		LOG_DEBUG("Using cached MusicBrainz results for: " << probe_key);
+		return std::move(*cached);
 	}
 
-	std::vector<std::pair<std::string, double>> releaseIds;
+	// Only a miss pays for an owned key (the flight map stores it)
+	const std::string cache_key(probe_key);
 
-	try {
-		auto root = nlohmann::json::parse(response);
+	// Concurrent searches for the same album share one request
+	return shared_lookup(search_flight, search_cache, cache_key, failures, [&] {
+		return fetch_release_ids_search(artist, album, date, scoreThreshold);
+	});
+}
 
-		// Find the release with the highest score above the threshold
-		double bestScore = -1.0;
-		std::string bestId;
+// Cache miss path of fingerprint_release_ids()
+static Lookup<Candidates> fetch_release_ids_fingerprint(
+		const std::string& cache_key,
+		int duration,
+		const std::string& fingerprint,
+		const std::string& acoustid_api)
+{
+	// The fingerprint is several KB: POST it (gzip-compressed, which
+	// AcoustID accepts) rather than putting it in the query string
+	const std::string url = "https://api.acoustid.org/v2/lookup";
+	const std::string form =
+		"client=" + url_encode(acoustid_api) +
+		"&meta=releaseids+releasegroupids&duration=" + std::to_string(duration) +
+		"&fingerprint=" + url_encode(fingerprint);
+
+	std::vector<std::string> headers = {
+		"Content-Type: application/x-www-form-urlencoded",
+	};
+	std::string body = gzip_compress(form);
+	if (!body.empty()) {
+		headers.push_back("Content-Encoding: gzip");
+		LOG_DEBUG("AcoustID request body: " << form.size() << " bytes, "
+				<< body.size() << " gzipped");
+	} else {
+		body = form;
+	}
 
-		if (root.contains("releases")) {
-			for (const auto& r : root["releases"]) {
-				// Safely check if score exists
-				if (r.contains("score") && r.contains("id")) {
-					double s = r["score"];
-					if (s >= scoreThreshold && s > bestScore) {
-						bestScore = s;
-						bestId = r["id"];
-					}
-				}
-			}
+	Lookup<Candidates> result;
 
-			if (bestScore >= scoreThreshold && !bestId.empty()) {
-				releaseIds.emplace_back(bestId, bestScore);
-				LOG_DEBUG("Found best match with ID: " << bestId 
-						<< " and score: " << bestScore);
-			} else {
-				LOG_DEBUG("No valid matches found above threshold");
-			}
-		} else {
-			LOG_DEBUG("No 'releases' field in response");
-		}
+	std::string response = post_response(url, body, headers);
+	if (response.empty()) {
+		LOG_ERR("Empty response from AcoustID for: " << cache_key);
+		return result;
+	}
+
+	AcoustIdSax sax;
+	if (!sax_extract(response, sax)) return result;
 
-	} catch (const std::exception& e) {
-		LOG_ERR("JSON parsing error: " << e.what());
+	// Errors (bad key, rate limited) are not answers
+	if (sax.status != "ok") {
+		LOG_ERR("AcoustID error status: " << (sax.status.empty() ? "(none)" : sax.status));
+		return result;
 	}
 
-	// Cache result
-	search_cache[cache_key] = releaseIds;
-	return releaseIds;
+	result.value.releases = std::move(sax.releaseIds);
+	result.value.groups   = std::move(sax.releaseGroupIds);
+	if (!sax.hasResult || (result.value.releases.empty() && result.value.groups.empty())) {
+		result.outcome = Outcome::NotFound;
+		LOG_DEBUG("No valid results found in AcoustID response");
+	} else {
+		result.outcome = Outcome::Found;
+		LOG_DEBUG("Found " << result.value.releases.size() << " releases in "
+				<< result.value.groups.size() << " release groups in AcoustID response");
+	}
+	return result;
 }
 
-std::vector<std::string> json_get_release_ids_fingerprint(
+static Lookup<Candidates> fingerprint_release_ids(
 		int duration,
 		const std::string& fingerprint,
 		const std::string& acoustid_api)
 {
-	std::string url =
-		"https://api.acoustid.org/v2/lookup?client=" + acoustid_api +
-		"&meta=releaseids&duration=" + std::to_string(duration) +
-		"&fingerprint=" + fingerprint;
+	const std::string cache_key = art_cache_fingerprint_key(fingerprint, duration);
 
-	std::string response = get_response(url);
-	if (response.empty()) {
-		LOG_ERR("Empty response from AcoustID for: " << url);
-		return {};
+	int failures = 0;
+	if (auto cached = cache_probe(acoustid_cache, cache_key, failures)) {
+		LOG_DEBUG("Using cached AcoustID results for: " << cache_key);
+		return std::move(*cached);
 	}
 
-	std::vector<std::string> releaseIds;
+	// Concurrent lookups of the same fingerprint share one request
+	return shared_lookup(acoustid_flight, acoustid_cache, cache_key, failures, [&] {
+		return fetch_release_ids_fingerprint(cache_key, duration, fingerprint, acoustid_api);
+	});
+}
 
-	try {
-		auto root = nlohmann::json::parse(response);
+static std::string get_album_art_url(const std::string& id)
+{
+	return "https://coverartarchive.org/release/" + id + "/front-500";
+}
 
-		// More robust parsing
-		if (root.contains("results") && 
-				root["results"].is_array() && 
-				!root["results"].empty()) {
+static std::string get_release_page_url(const std::string& id)
+{
+	return "https://musicbrainz.org/release/" + id;
+}
 
-			const auto& result = root["results"][0];
-			if (result.contains("releases") && 
-					result["releases"].is_array()) {
+static std::string get_release_group_art_url(const std::string& id)
+{
+	return "https://coverartarchive.org/release-group/" + id + "/front-500";
+}
 
-				LOG_DEBUG("Found " << result["releases"].size() 
-						<< " releases in AcoustID response");
+static std::string get_release_group_page_url(const std::string& id)
+{
+	return "https://musicbrainz.org/release-group/" + id;
+}
 
-				for (const auto& r : result["releases"]) {
-					if (r.contains("id")) {
-						releaseIds.push_back(r["id"]);
-						LOG_DEBUG("Added release ID: " << r["id"]);
-					}
-				}
-			} else {
-				LOG_DEBUG("No 'releases' field in AcoustID result");
+// Cover Art Archive HEAD checks for many releases (or release groups) at
+// once. Up to MAX_PARALLEL_CHECKS requests are in flight on one multi
+// handle; the first candidate (in order) with art wins and the rest are
+// cancelled. NotFound only when every candidate definitively has no art.
+//
+// Redirects are not followed: the archive answers 307 to the image on
+// archive.org when art exists, which is all we need to know, and the
+// target is kept as the image URL.
+static Lookup<CoverArt> find_cover_art(
+		const std::vector<std::string>& ids,
+		CoverOf kind = CoverOf::Release)
+{
+	static constexpr size_t MAX_PARALLEL_CHECKS = 6;
+
+	enum class State { Unknown, Pending, Exists, Missing, Failed };
+	std::vector<State>       states(ids.size(), State::Unknown);
+	std::vector<int>         failures(ids.size(), 0);
+	std::vector<std::string> images(ids.size());
+
+	// Cache and flight keys; release groups get their own namespace
+	std::vector<std::string> keys;
+	keys.reserve(ids.size());
+	for (const auto& id : ids)
+		keys.push_back(kind == CoverOf::Release ? id : "rg:" + id);
+
+	auto art_url = [&](size_t i) {
+		return kind == CoverOf::Release
+			? get_album_art_url(ids[i]) : get_release_group_art_url(ids[i]);
+	};
+
+	// Answer what we can from the cache
+	for (size_t i = 0; i < ids.size(); ++i) {
+		if (auto cached = cache_probe(cover_art_cache, keys[i], failures[i])) {
+			switch (cached->outcome) {
+				case Outcome::Found:
+					states[i] = State::Exists;
+					images[i] = std::move(cached->value);
+					break;
+				case Outcome::NotFound:  states[i] = State::Missing; break;
+				case Outcome::Transient: states[i] = State::Failed;  break;
 			}
-		} else {
-			LOG_DEBUG("No valid results found in AcoustID response");
 		}
+	}
 
-	} catch (const std::exception& e) {
-		LOG_ERR("JSON parsing error in AcoustID: " << e.what());
+	// Index of the first candidate that is not known to be without art
+	auto first_open = [&]() {
+		size_t i = 0;
+		while (i < states.size() &&
+				(states[i] == State::Missing || states[i] == State::Failed)) ++i;
+		return i;
+	};
+
+	// No winner: definitive only if no candidate failed transiently
+	auto no_winner = [&]() {
+		Lookup<CoverArt> result;
+		result.outcome = std::count(states.begin(), states.end(), State::Failed)
+			? Outcome::Transient : Outcome::NotFound;
+		return result;
+	};
+
+	auto won = [&](size_t i) {
+		Lookup<CoverArt> result;
+		result.value   = {ids[i], kind, images[i].empty() ? art_url(i) : images[i]};
+		result.outcome = Outcome::Found;
+		return result;
+	};
+
+	size_t front = first_open();
+	if (front == ids.size()) return no_winner();
+	if (states[front] == State::Exists) {
+		LOG_DEBUG("Using cached cover art check for ID: " << ids[front]);
+		return won(front);
 	}
 
-	return releaseIds;
-}
+	CURLM* multi = http_multi();
+	if (!multi) return {};
 
-// Over Art Archive
-bool cover_art_exists(const std::string& id)
-{
-	// Check cache first
-	auto cached = cover_art_cache.find(id);
-	if (cached != cover_art_cache.end()) {
-		LOG_DEBUG("Using cached cover art check for ID: " << id 
-				<< " (result: " << (cached->second ? "true" : "false") << ")");
-		return cached->second;
-	}
+	std::vector<std::string> urls(ids.size());
+	std::unordered_map<CURL*, size_t> inFlight;                  // our own checks
+	std::unordered_map<size_t, std::shared_future<CoverCheck>> joined; // another thread's
+	size_t next = front;
 
-	std::string art_url = get_album_art_url(id);
+	auto start_more = [&]() {
+		while (inFlight.size() < MAX_PARALLEL_CHECKS && next < ids.size()) {
+			size_t i = next++;
+			if (states[i] != State::Unknown) continue;
 
-	LOG_DEBUG("Checking cover art existence for ID: " << id 
-			<< " at URL: " << art_url);
+			// Someone else is already checking this release: wait for theirs
+			if (auto pending = cover_flight.join(keys[i])) {
+				joined.emplace(i, *pending);
+				states[i] = State::Pending;
+				continue;
+			}
+
+			urls[i] = art_url(i);
+
+			// Out of time for this lookup: a transient failure, but not
+			// the release's fault, so do not cache it
+			CURL* easy = http_acquire(urls[i]) ? curl_easy_init() : nullptr;
+			if (!easy) {
+				cover_flight.finish(keys[i], CoverCheck::Abandoned);
+				states[i] = State::Failed;
+				continue;
+			}
+			http_setup_handle(easy);
+			curl_easy_setopt(easy, CURLOPT_URL, urls[i].c_str());
+			curl_easy_setopt(easy, CURLOPT_NOBODY, 1L);
+			curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 0L);
+			curl_multi_add_handle(multi, easy);
+			inFlight.emplace(easy, i);
+			states[i] = State::Pending;
+			LOG_DEBUG("Checking cover art existence for ID: " << ids[i]);
+		}
+	};
+
+	auto finish = [&](CURL* easy) {
+		curl_multi_remove_handle(multi, easy);
+		curl_easy_cleanup(easy);
+		inFlight.erase(easy);
+	};
+
+	start_more();
+
+	bool haveWinner = false;
+	while (!inFlight.empty() || !joined.empty()) {
+		if (http_cancelled()) break;
+
+		int running = 0;
+		curl_multi_perform(multi, &running);
+
+		int queued = 0;
+		while (CURLMsg* msg = curl_multi_info_read(multi, &queued)) {
+			if (msg->msg != CURLMSG_DONE) continue;
+
+			CURL* easy = msg->easy_handle;
+			size_t i = inFlight.at(easy);
+			const bool ok = msg->data.result == CURLE_OK;
+			long code = 0;
+			char* location = nullptr;
+			if (ok) {
+				curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &code);
+				curl_easy_getinfo(easy, CURLINFO_REDIRECT_URL, &location);
+			}
+
+			// 200 or a redirect to the image mean art exists; 404 (no art)
+			// and 400 (not a release MBID) are answers; anything else
+			// (timeouts, throttling, 5xx) is retried later
+			Lookup<std::string> check;
+			if (ok && code == 200)
+				check = {urls[i], Outcome::Found};
+			else if (ok && code >= 300 && code < 400 && location && *location)
+				check = {location, Outcome::Found};
+			else if (ok && (code == 404 || code == 400))
+				check = {"", Outcome::NotFound};
+
+			// Aborted by cancellation or the deadline: not an answer, waiters retry
+			const bool cancelled = check.outcome == Outcome::Transient && http_abandoned();
+			const CoverCheck result = cancelled ? CoverCheck::Abandoned :
+				check.outcome == Outcome::Found    ? CoverCheck::Exists :
+				check.outcome == Outcome::NotFound ? CoverCheck::Missing : CoverCheck::Failed;
+			states[i] =
+				result == CoverCheck::Exists  ? State::Exists :
+				result == CoverCheck::Missing ? State::Missing : State::Failed;
+			images[i] = check.value;
+			if (!cancelled) cache_store(cover_art_cache, keys[i], check, failures[i]);
+			cover_flight.finish(keys[i], result);
+			LOG_DEBUG("Cover art check for ID " << ids[i] << " returned: " << code
+					<< (result == CoverCheck::Exists ? " -> " + images[i] : "")
+					<< (result == CoverCheck::Failed ? " (transient)" : ""));
+			http_record_transfer(easy);
+			finish(easy);
+		}
 
-	CURL* curl = curl_easy_init();
-	if (!curl) {
-		cover_art_cache[id] = false;
-		return false;
+		// Collect results of checks other threads ran for us
+		for (auto it = joined.begin(); it != joined.end(); ) {
+			if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++it;
+				continue;
+			}
+			const size_t i = it->first;
+			switch (it->second.get()) {
+				case CoverCheck::Exists: {
+					// The leader cached the image URL before finishing
+					states[i] = State::Exists;
+					int unused = 0;
+					if (auto cached = cache_probe(cover_art_cache, keys[i], unused))
+						images[i] = std::move(cached->value);
+					break;
+				}
+				case CoverCheck::Missing: states[i] = State::Missing; break;
+				case CoverCheck::Failed:  states[i] = State::Failed;  break;
+				case CoverCheck::Abandoned:
+					// The other thread gave up on it; check it ourselves
+					states[i] = State::Unknown;
+					next = std::min(next, i);
+					break;
+			}
+			it = joined.erase(it);
+		}
+
+		// A hit only wins once every earlier candidate is known to be missing
+		front = first_open();
+		if (front == ids.size()) break;
+		if (states[front] == State::Exists) {
+			haveWinner = true;
+			break;
+		}
+
+		start_more();
+		if (!inFlight.empty() || !joined.empty())
+			curl_multi_poll(multi, nullptr, 0, joined.empty() ? 1000 : 50, nullptr);
+	}
+
+	// Cancel checks that can no longer change the answer
+	if (!inFlight.empty()) {
+		LOG_DEBUG("Cancelling " << inFlight.size() << " cover art check(s)");
+		while (!inFlight.empty()) {
+			CURL* easy = inFlight.begin()->first;
+			cover_flight.finish(keys[inFlight.begin()->second], CoverCheck::Abandoned);
+			finish(easy);
+		}
 	}
 
-	curl_easy_setopt(curl, CURLOPT_URL, art_url.c_str());
-	curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
-	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-	curl_easy_setopt(curl, CURLOPT_USERAGENT, "MPD-Presence");
+	if (haveWinner) return won(front);
+	return first_open() == ids.size() ? no_winner() : Lookup<CoverArt>{};
+}
 
-	CURLcode res = curl_easy_perform(curl);
-	long code = 0;
-	if (res == CURLE_OK) {
-		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+// Check a lookup's release groups and releases, in the given order. One
+// release group request covers every edition of an album, so it is tried
+// first when there are many releases to go through.
+static Lookup<CoverArt> find_cover_art(const Candidates& candidates, bool groupsFirst)
+{
+	const std::pair<const std::vector<std::string>*, CoverOf> releases{
+		&candidates.releases, CoverOf::Release};
+	const std::pair<const std::vector<std::string>*, CoverOf> groups{
+		&candidates.groups, CoverOf::ReleaseGroup};
+
+	bool transient = false;
+	for (const auto& [ids, kind] : {groupsFirst ? groups : releases, groupsFirst ? releases : groups}) {
+		if (ids->empty()) continue;
+		Lookup<CoverArt> found = find_cover_art(*ids, kind);
+		if (found.outcome == Outcome::Found) return found;
+		transient |= found.outcome == Outcome::Transient;
 	}
 
-	curl_easy_cleanup(curl);
+	Lookup<CoverArt> result;
+	result.outcome = transient ? Outcome::Transient : Outcome::NotFound;
+	return result;
+}
 
-	bool exists = (res == CURLE_OK && code == 200);
-	cover_art_cache[id] = exists; // Cache result
-	LOG_DEBUG("Cover art check for ID " << id 
-			<< " returned: " << (exists ? "true" : "false"));
-	return exists;
+void log_album_art_cache_stats()
+{
+	auto log_one = [](const char* name, const auto& cache) {
+		const auto st = cache.stats();
+		LOG_INFO("Cache " << name << ": " << st.entries << " entries, "
+				<< st.bytes << " bytes, " << st.hits << " hits, "
+				<< st.misses << " misses, " << st.evictions << " evictions");
+	};
+	log_one("musicbrainz", search_cache);
+	log_one("acoustid", acoustid_cache);
+	log_one("coverart", cover_art_cache);
 }
 
-std::string get_album_art_url(const std::string& id)
+// Cover (the resolved image URL) and MusicBrainz page for a hit
+static AlbumUrls album_urls_for(const CoverArt& art)
 {
-	return "https://coverartarchive.org/release/" + id + "/front-500";
+	AlbumUrls result;
+	result.cover_url = art.image;
+	result.page_url  = art.kind == CoverOf::Release
+		? get_release_page_url(art.id) : get_release_group_page_url(art.id);
+	LOG_INFO("Found album art URL: " << result.cover_url);
+	LOG_INFO("Found release page URL: " << result.page_url);
+	return result;
 }
 
-std::string get_release_page_url(const std::string& id)
+// Shared tail of get_album_urls_*(): pick the candidate with art, then
+// record the answer under `cache_key`. Found and definitive not-found
+// results are persisted; a transient failure leaves any stale cached entry
+// untouched.
+static AlbumUrls finish_album_lookup(
+		const std::string& cache_key,
+		const Lookup<Candidates>& candidates,
+		bool groupsFirst)
 {
-	return "https://musicbrainz.org/release/" + id;
+	Lookup<CoverArt> art;
+	if (candidates.outcome == Outcome::Found)
+		art = find_cover_art(candidates.value, groupsFirst);
+	else
+		art.outcome = candidates.outcome;
+
+	switch (art.outcome) {
+		case Outcome::Found: {
+			AlbumUrls result = album_urls_for(art.value);
+			art_cache_put(cache_key, result);
+			return result;
+		}
+		case Outcome::NotFound:
+			LOG_DEBUG("No cover art exists for: " << cache_key);
+			art_cache_put(cache_key, {});
+			return {};
+		case Outcome::Transient:
+			break;
+	}
+
+	LOG_DEBUG("Cover art lookup failed for: " << cache_key);
+	return {};
 }
 
 AlbumUrls get_album_urls_search(
@@ -267,25 +742,17 @@ AlbumUrls get_album_urls_search(
 	LOG_DEBUG("Starting search for artist: " << artist 
 			<< ", album: " << album << ", date: " << date);
 
-	auto releases = json_get_release_ids_search(artist, album, date, score);
+	// Fresh answers (including "no art") end here; stale ones are looked up again
+	const std::string cache_key = art_cache_album_key(artist, album, date);
+	if (auto cached = art_cache_get(cache_key); cached && !cached->stale)
+		return cached->urls;
 
-	LOG_DEBUG("Found " << releases.size() << " releases from MusicBrainz");
+	auto releases = search_release_ids(artist, album, date, score);
 
-	AlbumUrls result = {};
-
-	for (const auto& [id, _] : releases) {
-		LOG_DEBUG("Checking cover art for release ID: " << id);
-		if (cover_art_exists(id)) {
-			result.cover_url = get_album_art_url(id);
-			result.page_url = get_release_page_url(id);
-			LOG_INFO("Found album art URL: " << result.cover_url);
-			LOG_INFO("Found release page URL: " << result.page_url);
-			return result;
-		}
-	}
+	LOG_DEBUG("Found " << releases.value.releases.size() << " releases from MusicBrainz");
 
-	LOG_DEBUG("No valid cover art found for search query");
-	return {};
+	// The matched edition first, then its release group
+	return finish_album_lookup(cache_key, releases, false);
 }
 
 AlbumUrls get_album_urls_fingerprint(
@@ -296,23 +763,55 @@ AlbumUrls get_album_urls_fingerprint(
 	LOG_DEBUG("Starting fingerprint lookup with duration: " << duration 
 			<< ", fingerprint: " << fingerprint.substr(0, 10) << "...");
 
-	auto releases = json_get_release_ids_fingerprint(duration, fingerprint, acoustid_api);
+	const std::string cache_key = art_cache_fingerprint_key(fingerprint, duration);
+	if (auto cached = art_cache_get(cache_key); cached && !cached->stale)
+		return cached->urls;
+
+	auto releases = fingerprint_release_ids(duration, fingerprint, acoustid_api);
 
-	LOG_DEBUG("Found " << releases.size() << " releases from AcoustID");
+	LOG_DEBUG("Found " << releases.value.releases.size() << " releases from AcoustID");
 
-	AlbumUrls result = {};
+	// A recording is usually on many editions: one request per release
+	// group beats checking each release
+	return finish_album_lookup(cache_key, releases, true);
+}
+
+AlbumUrls get_album_urls_tags(
+		const std::string& releaseID,
+		const std::string& releaseGroupID)
+{
+	LOG_DEBUG("Starting tag lookup with release: " << releaseID
+			<< ", release group: " << releaseGroupID);
+
+	// Try the tagged release first, then any release of its group
+	struct Candidate {
+		const std::string& id;
+		CoverOf            kind;
+		std::string        cache_key;
+	};
+	std::vector<Candidate> candidates;
+	if (!releaseID.empty())
+		candidates.push_back({releaseID, CoverOf::Release, art_cache_release_key(releaseID)});
+	if (!releaseGroupID.empty())
+		candidates.push_back({releaseGroupID, CoverOf::ReleaseGroup,
+				art_cache_release_group_key(releaseGroupID)});
+
+	for (const auto& c : candidates) {
+		if (auto cached = art_cache_get(c.cache_key); cached && !cached->stale) {
+			if (!cached->urls.cover_url.empty()) return cached->urls;
+			continue; // known to have no art
+		}
 
-	for (const auto& id : releases) {
-		LOG_DEBUG("Checking cover art for release ID: " << id);
-		if (cover_art_exists(id)) {
-			result.cover_url = get_album_art_url(id);
-			result.page_url = get_release_page_url(id);
-			LOG_INFO("Found album art URL: " << result.cover_url);
-			LOG_INFO("Found release page URL: " << result.page_url);
+		const Lookup<CoverArt> found = find_cover_art({c.id}, c.kind);
+		if (found.outcome == Outcome::Found) {
+			AlbumUrls result = album_urls_for(found.value);
+			art_cache_put(c.cache_key, result);
 			return result;
 		}
+		if (found.outcome == Outcome::NotFound)
+			art_cache_put(c.cache_key, {});
 	}
 
-	LOG_DEBUG("No valid cover art found for fingerprint");
+	LOG_DEBUG("No valid cover art found for tagged IDs");
 	return {};
 }
@@ -2,7 +2,6 @@
 
 #include <string>
 #include <vector>
-#include <utility>
 
 // Album Cover + Page url
 struct AlbumUrls {
@@ -21,21 +20,11 @@ AlbumUrls get_album_urls_fingerprint(
 		const std::string& fingerprint,
 		const std::string& acoustid_api);
 
-// MusicBrainz search
-std::vector<std::pair<std::string, double>>
-json_get_release_ids_search(
-		const std::string& artist,
-		const std::string& album,
-		const std::string& date,
-		double score = 90.0);
-
-// AcoustID fingerprint
-std::vector<std::string>
-json_get_release_ids_fingerprint(
-		int duration,
-		const std::string& fingerprint,
-		const std::string& acoustid_api);
+// Cover Art Archive straight from MusicBrainz ID tags (release, then
+// release group); either ID may be empty. No MusicBrainz/AcoustID requests.
+AlbumUrls get_album_urls_tags(
+		const std::string& releaseID,
+		const std::string& releaseGroupID);
 
-// Cover Art Archive helpers
-bool cover_art_exists(const std::string& id);
-std::string get_album_art_url(const std::string& id);
+// Log hit/miss/eviction counters of the in-memory lookup caches
+void log_album_art_cache_stats();
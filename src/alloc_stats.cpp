@@ -0,0 +1,29 @@
+#include "alloc_stats.hpp"
+
+#ifdef MPDP_ALLOC_STATS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> g_allocations{0};
+
+// The array and nothrow forms call these, so they are counted too
+void* operator new(std::size_t size) {
+	g_allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept              { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+bool     alloc_stats_enabled() { return true; }
+uint64_t alloc_stats_count()   { return g_allocations.load(std::memory_order_relaxed); }
+
+#else
+
+bool     alloc_stats_enabled() { return false; }
+uint64_t alloc_stats_count()   { return 0; }
+
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+#include <cstdint>
+
+// Process-wide count of heap allocations made through operator new, for
+// checking that steady-state main loop iterations allocate nothing.
+// Counting replaces the global operator new, so it is only compiled in
+// with -DALLOC_STATS=ON; otherwise the count stays 0.
+bool     alloc_stats_enabled();
+uint64_t alloc_stats_count();
@@ -0,0 +1,446 @@
+#include "art_cache.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "logger.hpp"
+
+namespace {
+
+	constexpr const char* FILE_HEADER    = "MPDP-ART 2";
+	constexpr const char* FILE_HEADER_V1 = "MPDP-ART 1"; // no refresh field
+
+	// Found art is served for FOUND_TTL but looked up again (in the
+	// background) after FOUND_REFRESH. "No art" is only trusted for a day.
+	constexpr int64_t FOUND_REFRESH_SECONDS = 30 * 24 * 3600;
+	constexpr int64_t FOUND_TTL_SECONDS     = 180 * 24 * 3600;
+	constexpr int64_t NOT_FOUND_TTL_SECONDS = 24 * 3600;
+
+	// Rewrite the file at startup once dead records outnumber live ones
+	constexpr size_t COMPACT_MIN_RECORDS = 256;
+
+	// How often lookups check the file for records other processes appended
+	constexpr auto RELOAD_CHECK_INTERVAL = std::chrono::seconds(5);
+
+	struct Entry {
+		int64_t   refresh = 0; // stale from here on
+		int64_t   expires = 0; // dropped from here on
+		AlbumUrls urls;
+	};
+
+	std::mutex                             cacheMutex;
+	std::unordered_map<std::string, Entry> entries;
+	std::filesystem::path                  cachePath;
+	int                                    appendFd = -1;
+
+	// Shared flock on art.cache.lock, held by every process that has the
+	// cache open (the daemon, --prewarm). Compaction replaces the file, so
+	// it only runs when the exclusive lock can be had.
+	int lockFd = -1;
+
+	// The file as loaded: its inode, format version, and how many bytes of
+	// it have been applied to `entries`
+	dev_t  loadedDev   = 0;
+	ino_t  loadedIno   = 0;
+	int    fileVersion = 2;
+	size_t readOffset  = 0;
+
+	std::chrono::steady_clock::time_point nextReloadCheck;
+
+	int64_t now_seconds() {
+		return static_cast<int64_t>(std::time(nullptr));
+	}
+
+	// FNV-1a: stable across builds, which std::hash is not
+	uint64_t fnv1a64(const std::string& s) {
+		uint64_t h = 14695981039346656037ull;
+		for (unsigned char c : s) {
+			h ^= c;
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	std::string to_hex(uint64_t v, int digits) {
+		char buf[17];
+		std::snprintf(buf, sizeof(buf), "%0*llx", digits, static_cast<unsigned long long>(v));
+		return buf;
+	}
+
+	// Fields are tab separated; keep tabs/newlines out of them
+	std::string sanitize(std::string s) {
+		for (char& c : s)
+			if (c == '\t' || c == '\n' || c == '\r') c = ' ';
+		return s;
+	}
+
+	std::string format_record(const std::string& key, const Entry& e) {
+		std::string body = std::to_string(e.refresh) + '\t' +
+			std::to_string(e.expires) + '\t' + key + '\t' +
+			e.urls.cover_url + '\t' + e.urls.page_url;
+		return body + '\t' + to_hex(fnv1a64(body) & 0xffffffffu, 8) + '\n';
+	}
+
+	// Returns false for truncated or corrupted lines. Version 1 records have
+	// no refresh time; they become stale when they would have expired.
+	bool parse_record(const std::string& line, int version, std::string& key, Entry& e) {
+		size_t sumPos = line.rfind('\t');
+		if (sumPos == std::string::npos) return false;
+
+		const std::string body = line.substr(0, sumPos);
+		if (line.compare(sumPos + 1, std::string::npos,
+					to_hex(fnv1a64(body) & 0xffffffffu, 8)) != 0)
+			return false;
+
+		std::vector<std::string> fields;
+		std::istringstream iss(body);
+		std::string field;
+		while (std::getline(iss, field, '\t')) fields.push_back(field);
+		if (body.back() == '\t') fields.emplace_back();
+		const size_t n = (version == 1) ? 4 : 5;
+		if (fields.size() != n) return false;
+
+		auto parse_time = [](const std::string& f, int64_t& out) {
+			char* end = nullptr;
+			out = std::strtoll(f.c_str(), &end, 10);
+			return !f.empty() && *end == '\0';
+		};
+
+		if (version == 1) {
+			if (!parse_time(fields[0], e.refresh)) return false;
+			e.expires = e.refresh;
+			if (!fields[2].empty()) e.expires += FOUND_TTL_SECONDS - FOUND_REFRESH_SECONDS;
+		} else if (!parse_time(fields[0], e.refresh) || !parse_time(fields[1], e.expires)) {
+			return false;
+		}
+
+		key              = fields[n - 3];
+		e.urls.cover_url = fields[n - 2];
+		e.urls.page_url  = fields[n - 1];
+		return !key.empty();
+	}
+
+	std::filesystem::path default_cache_path() {
+		std::filesystem::path dir;
+		if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+			dir = xdg;
+		else if (const char* home = std::getenv("HOME"); home && *home)
+			dir = std::filesystem::path(home) / ".cache";
+		else
+			return {};
+		return dir / "MPD-Presence" / "art.cache";
+	}
+
+	// Write live entries to a temp file and atomically replace the log.
+	// Must be called with cacheMutex held and appendFd closed.
+	bool compact_locked() {
+		std::filesystem::path tmp = cachePath;
+		tmp += ".tmp";
+
+		{
+			std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+			if (!out) return false;
+			out << FILE_HEADER << '\n';
+			for (const auto& [key, e] : entries) out << format_record(key, e);
+			out.flush();
+			if (!out) return false;
+		}
+
+		std::error_code ec;
+		std::filesystem::rename(tmp, cachePath, ec);
+		if (ec) {
+			LOG_WARN("Album art cache compaction failed: " << ec.message());
+			std::filesystem::remove(tmp, ec);
+			return false;
+		}
+		return true;
+	}
+
+	struct LoadResult {
+		size_t records  = 0;
+		size_t skipped  = 0;
+		bool   headerOk = true;
+		bool   torn     = false; // the file ends in an unterminated line
+	};
+
+	// Apply the complete records from readOffset to the end of the file,
+	// checking the header first when starting from 0. Later records
+	// override earlier ones. Must be called with cacheMutex held.
+	LoadResult read_records_locked() {
+		LoadResult r;
+		std::ifstream in(cachePath, std::ios::binary);
+		if (!in) return r;
+		in.seekg(static_cast<std::streamoff>(readOffset));
+		std::ostringstream ss;
+		ss << in.rdbuf();
+		const std::string data = ss.str();
+
+		const int64_t now = now_seconds();
+		size_t pos = 0;
+		if (readOffset == 0 && !data.empty()) {
+			size_t eol = data.find('\n');
+			if (eol == std::string::npos) return r; // header still being written
+			const std::string header = data.substr(0, eol);
+			fileVersion = (header == FILE_HEADER_V1) ? 1 : 2;
+			if (header != FILE_HEADER && header != FILE_HEADER_V1) {
+				r.headerOk = false;
+				return r;
+			}
+			pos = eol + 1;
+		}
+
+		while (pos < data.size()) {
+			size_t eol = data.find('\n', pos);
+			if (eol == std::string::npos) { // torn (or unfinished) write
+				r.skipped++;
+				r.torn = true;
+				break;
+			}
+			std::string line = data.substr(pos, eol - pos);
+			pos = eol + 1;
+
+			std::string key;
+			Entry e;
+			if (!parse_record(line, fileVersion, key, e)) { r.skipped++; continue; }
+			r.records++;
+			if (e.expires <= now) { entries.erase(key); continue; }
+			entries[key] = std::move(e);
+		}
+		readOffset += pos;
+		return r;
+	}
+
+	// (Re)open the append descriptor on the current file and remember its
+	// inode. Must be called with cacheMutex held.
+	bool open_append_locked() {
+		if (appendFd >= 0) ::close(appendFd);
+		appendFd = ::open(cachePath.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+		if (appendFd < 0) {
+			LOG_WARN("Cannot open album art cache for writing: " << std::strerror(errno));
+			return false;
+		}
+
+		struct stat st;
+		if (::fstat(appendFd, &st) == 0) {
+			loadedDev = st.st_dev;
+			loadedIno = st.st_ino;
+		}
+
+		// A freshly created file needs its header
+		if (::lseek(appendFd, 0, SEEK_END) == 0) {
+			const std::string header = std::string(FILE_HEADER) + '\n';
+			if (::write(appendFd, header.data(), header.size()) < 0)
+				LOG_WARN("Failed to write album art cache header");
+			fileVersion = 2;
+			readOffset  = header.size();
+		}
+		return true;
+	}
+
+	// Pick up what other processes changed since the file was loaded: a
+	// replaced file (another process compacted it, or it was deleted) is
+	// reloaded and reopened, so appends never go to an unlinked inode;
+	// records appended by others are applied. Must be called with
+	// cacheMutex held.
+	void sync_with_file_locked() {
+		if (appendFd < 0) return;
+
+		struct stat st;
+		const bool replaced = ::stat(cachePath.c_str(), &st) != 0 ||
+			st.st_dev != loadedDev || st.st_ino != loadedIno;
+		if (replaced) {
+			LOG_INFO("Album art cache file was replaced, reloading");
+			readOffset = 0;
+			if (!open_append_locked()) return;
+			read_records_locked();
+		} else if (static_cast<size_t>(st.st_size) > readOffset) {
+			const size_t before = entries.size();
+			read_records_locked();
+			LOG_DEBUG("Album art cache: applied records from other processes ("
+					<< entries.size() - std::min(before, entries.size()) << " new keys)");
+		}
+	}
+
+} // anonymous namespace
+
+bool art_cache_open() {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (appendFd >= 0) return true;
+
+	cachePath = default_cache_path();
+	if (cachePath.empty()) {
+		LOG_WARN("No XDG_CACHE_HOME or HOME -- album art cache disabled");
+		return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::create_directories(cachePath.parent_path(), ec);
+	if (ec) {
+		LOG_WARN("Cannot create " << cachePath.parent_path().string() << ": " << ec.message());
+		return false;
+	}
+
+	// Another process (the daemon, or a concurrent --prewarm) may have the
+	// cache open. Only without one is it safe to replace the file.
+	std::filesystem::path lockPath = cachePath;
+	lockPath += ".lock";
+	lockFd = ::open(lockPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	bool exclusive = false;
+	if (lockFd < 0) {
+		LOG_WARN("Cannot open " << lockPath.string() << ": " << std::strerror(errno));
+	} else {
+		exclusive = ::flock(lockFd, LOCK_EX | LOCK_NB) == 0;
+		// Blocks only while another process is compacting
+		if (!exclusive) ::flock(lockFd, LOCK_SH);
+	}
+
+	struct stat st;
+	if (::stat(cachePath.c_str(), &st) == 0) {
+		loadedDev = st.st_dev;
+		loadedIno = st.st_ino;
+	}
+	readOffset = 0;
+	const LoadResult loaded = read_records_locked();
+	if (!loaded.headerOk) {
+		LOG_WARN("Unknown album art cache format, starting fresh");
+		entries.clear();
+	}
+
+	LOG_INFO("Album art cache: " << entries.size() << " entries loaded from " << cachePath.string()
+			<< (loaded.skipped ? " (" + std::to_string(loaded.skipped) + " corrupt lines skipped)" : ""));
+
+	// Old-format files are rewritten in the current format
+	const bool rewrite = !loaded.headerOk || fileVersion != 2;
+	bool compacted = false;
+	if (rewrite || loaded.skipped > 0 ||
+			(loaded.records >= COMPACT_MIN_RECORDS && loaded.records > 2 * entries.size())) {
+		if (exclusive) {
+			LOG_DEBUG("Compacting album art cache (" << loaded.records << " records, "
+					<< entries.size() << " live)");
+			compacted = compact_locked();
+			if (compacted) {
+				std::error_code ec;
+				readOffset = static_cast<size_t>(std::filesystem::file_size(cachePath, ec));
+				fileVersion = 2;
+			}
+		} else if (rewrite) {
+			// Appending current-format records to it would corrupt them
+			LOG_WARN("Album art cache is in use by another process and needs "
+					"rewriting; new results will not be saved this run");
+			return false;
+		} else {
+			LOG_DEBUG("Album art cache in use by another process, not compacting");
+		}
+	}
+
+	if (!open_append_locked()) return false;
+
+	// An uncompacted torn final line must not swallow the next record
+	if (loaded.torn && !compacted && ::write(appendFd, "\n", 1) < 0)
+		LOG_WARN("Failed to append to album art cache: " << std::strerror(errno));
+
+	// Now that the file is in its final form, others may open it too
+	if (exclusive) ::flock(lockFd, LOCK_SH);
+
+	nextReloadCheck = std::chrono::steady_clock::now() + RELOAD_CHECK_INTERVAL;
+	return true;
+}
+
+std::string art_cache_directory() {
+	std::filesystem::path path = default_cache_path();
+	return path.empty() ? std::string() : path.parent_path().string();
+}
+
+std::optional<ArtCacheEntry> art_cache_get(const std::string& key) {
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	if (const auto now = std::chrono::steady_clock::now(); now >= nextReloadCheck) {
+		nextReloadCheck = now + RELOAD_CHECK_INTERVAL;
+		sync_with_file_locked();
+	}
+	auto it = entries.find(key);
+	if (it == entries.end()) return std::nullopt;
+
+	const int64_t now = now_seconds();
+	if (it->second.expires <= now) {
+		entries.erase(it);
+		return std::nullopt;
+	}
+
+	ArtCacheEntry hit;
+	hit.urls  = it->second.urls;
+	hit.stale = it->second.refresh <= now;
+	LOG_DEBUG("Album art cache hit: " << key << (hit.stale ? " (stale)" : ""));
+	return hit;
+}
+
+void art_cache_put(const std::string& key, const AlbumUrls& urls) {
+	Entry e;
+	e.urls.cover_url = sanitize(urls.cover_url);
+	e.urls.page_url  = sanitize(urls.page_url);
+	const int64_t now = now_seconds();
+	if (urls.cover_url.empty()) {
+		e.refresh = e.expires = now + NOT_FOUND_TTL_SECONDS;
+	} else {
+		e.refresh = now + FOUND_REFRESH_SECONDS;
+		e.expires = now + FOUND_TTL_SECONDS;
+	}
+
+	const std::string record = format_record(key, e);
+
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	sync_with_file_locked(); // never append to a file that has been replaced
+	entries[key] = std::move(e);
+
+	// One write() per record: O_APPEND keeps it atomic, and a torn write
+	// after a crash only loses this line (its checksum will not match).
+	if (appendFd >= 0 && ::write(appendFd, record.data(), record.size()) < 0)
+		LOG_WARN("Failed to append to album art cache: " << std::strerror(errno));
+}
+
+std::string art_cache_album_key(
+		const std::string& artist,
+		const std::string& album,
+		const std::string& date)
+{
+	return "album:" + sanitize(artist) + '\x1f' + sanitize(album) + '\x1f' + sanitize(date);
+}
+
+std::string art_cache_release_key(const std::string& mbAlbumID)
+{
+	return "mbid:" + sanitize(mbAlbumID);
+}
+
+std::string art_cache_release_group_key(const std::string& mbReleaseGroupID)
+{
+	return "mbrg:" + sanitize(mbReleaseGroupID);
+}
+
+std::string art_cache_release_index_key(const std::string& mbAlbumID)
+{
+	return "album-mbid:" + sanitize(mbAlbumID);
+}
+
+std::string art_cache_release_group_index_key(const std::string& mbReleaseGroupID)
+{
+	return "album-mbrg:" + sanitize(mbReleaseGroupID);
+}
+
+std::string art_cache_fingerprint_key(const std::string& fingerprint, int duration)
+{
+	return "fp:" + to_hex(fnv1a64(fingerprint), 16) + ':' + std::to_string(duration);
+}
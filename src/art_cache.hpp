@@ -0,0 +1,63 @@
+#pragma once
+
+#include <optional>
+#include <string>
+
+#include "album_art.hpp"
+
+// Persistent album-art cache, stored as an append-only record log under
+// $XDG_CACHE_HOME/MPD-Presence/ (or ~/.cache/MPD-Presence/).
+//
+// Each line is one record: refresh time, expiry, key, cover URL, page URL
+// and a checksum.
+// The file is read in one go at startup; later records override earlier
+// ones, expired or corrupt lines are skipped, and the file is rewritten
+// (temp file + rename) when it holds mostly dead records.
+//
+// Several processes may share the file (the daemon and --prewarm): each
+// holds a shared flock on art.cache.lock, and the rewrite only happens when
+// no other process has the cache open. Records appended by other processes
+// are picked up every few seconds, and a file replaced behind our back is
+// reloaded before the next append.
+//
+// An entry with an empty cover URL is a cached "no art" result. Those
+// expire after a day. Found art goes stale after 30 days: it is still
+// returned (flagged stale) so callers can show it while looking it up again,
+// until it finally expires after 180 days. Transient lookup failures are
+// never stored here.
+
+struct ArtCacheEntry {
+	AlbumUrls urls;
+	bool      stale = false; // past its refresh time: usable, but look it up again
+};
+
+// Load the cache file. Safe to skip: lookups then simply miss.
+bool art_cache_open();
+
+// Directory holding the cache file ("" when no cache location exists).
+std::string art_cache_directory();
+
+// Look up a non-expired entry.
+std::optional<ArtCacheEntry> art_cache_get(const std::string& key);
+
+// Record a result and append it to the cache file.
+void art_cache_put(const std::string& key, const AlbumUrls& urls);
+
+// Cache keys
+std::string art_cache_album_key(
+		const std::string& artist,
+		const std::string& album,
+		const std::string& date);
+
+std::string art_cache_release_key(const std::string& mbAlbumID);
+
+std::string art_cache_release_group_key(const std::string& mbReleaseGroupID);
+
+// Album index: the cover resolved (by any method) for the album a tagged
+// release or release group belongs to. Kept apart from the keys above,
+// which only ever hold the Cover Art Archive answer for that exact ID.
+std::string art_cache_release_index_key(const std::string& mbAlbumID);
+
+std::string art_cache_release_group_index_key(const std::string& mbReleaseGroupID);
+
+std::string art_cache_fingerprint_key(const std::string& fingerprint, int duration);
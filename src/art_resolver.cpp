@@ -0,0 +1,454 @@
+#include "art_resolver.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <semaphore>
+#include <thread>
+#include <unordered_set>
+
+#include "album_art.hpp"
+#include "art_cache.hpp"
+#include "http_client.hpp"
+#include "config.hpp"
+#include "event_loop.hpp"
+#include "rpc.hpp"
+#include "logger.hpp"
+#include "mpd.hpp"
+#include "ring_queue.hpp"
+
+namespace {
+
+	std::vector<std::string> methods;
+
+	using Clock = std::chrono::steady_clock;
+
+	// Upper bound on network time spent per prefetch job; current-track
+	// jobs use the art_timeout setting
+	constexpr auto PREFETCH_JOB_BUDGET = std::chrono::seconds(120);
+
+	// How long a less preferred method's hit waits for a better method
+	constexpr auto PREFERENCE_GRACE = std::chrono::seconds(2);
+
+	// Wake-up interval while methods race
+	constexpr auto RACE_POLL = std::chrono::milliseconds(50);
+
+	// Bound on queued background refreshes of stale entries
+	constexpr size_t MAX_REVALIDATE_JOBS = 16;
+
+	// Pipeline: the main thread (MPD watcher) feeds `tracks`, the worker
+	// resolves, and results go back through `results` to the main thread,
+	// which publishes them to Discord. Only the newest track matters, so
+	// both queues drop their oldest entries rather than block.
+	constexpr size_t TRACK_QUEUE_SIZE  = 4;
+	constexpr size_t RESULT_QUEUE_SIZE = 8;
+
+	RingQueue<ArtJob>    tracks(TRACK_QUEUE_SIZE);
+	RingQueue<ArtResult> results(RESULT_QUEUE_SIZE);
+
+	// Track jobs taken off the queue unprocessed because a newer one followed
+	std::atomic<uint64_t> superseded{0};
+
+	// Background work is replaced in batches, which a ring cannot do
+	std::mutex         queueMutex;
+	std::deque<ArtJob> prefetchQueue;
+	std::deque<ArtJob> revalidateQueue;
+
+	// Albums with a refresh queued or running, so replaying an album with
+	// stale art refreshes it once rather than once per track
+	std::unordered_set<std::string> revalidating;
+
+	// One release per queued item (or stop); the worker sleeps on it
+	std::counting_semaphore<> workAvailable{0};
+
+	std::thread       worker;
+	std::atomic<bool> running{false};
+
+	// The job is stale once the main thread has moved on to another song.
+	// Prefetch jobs are never stale; they are only superseded in the queue.
+	bool is_stale(const ArtJob& job) {
+		return !job.prefetch && rpc_get_current_song_id() != job.songID;
+	}
+
+	// Slow work (MPD decoding a file) is abandoned once its result is no
+	// longer wanted: the song changed, a current-track job is waiting
+	// behind a prefetch, or the resolver is stopping
+	bool abandoned(const ArtJob& job) {
+		if (is_stale(job)) return true;
+		return !running || (job.prefetch && tracks.depth() > 0);
+	}
+
+	// Keys of the album-level index for this job, most specific first.
+	// Every track of an album shares one cover, so only the first track
+	// of an album ever needs a network lookup. The art may come from
+	// another edition, so the tag IDs are indexed under their own
+	// namespace, not the per-release keys the tags method caches under.
+	std::vector<std::string> album_keys(const ArtJob& job) {
+		std::vector<std::string> keys;
+		if (!job.mbAlbumID.empty())
+			keys.push_back(art_cache_release_index_key(job.mbAlbumID));
+		if (!job.mbReleaseGroupID.empty())
+			keys.push_back(art_cache_release_group_index_key(job.mbReleaseGroupID));
+		if (!job.albumArtist.empty() && job.albumArtist != "Unknown Artist" &&
+				!job.album.empty() && job.album != "Unknown Album")
+			keys.push_back(art_cache_album_key(job.albumArtist, job.album, job.date));
+		return keys;
+	}
+
+	// Record a resolved cover for the whole album
+	void record_album(const ArtJob& job, const AlbumUrls& urls) {
+		for (const auto& key : album_keys(job)) art_cache_put(key, urls);
+	}
+
+	bool searchable(const ArtJob& job) {
+		return !job.artist.empty() && job.artist != "Unknown Artist" &&
+			!job.album.empty()  && job.album  != "Unknown Album"  &&
+			!job.date.empty()   && job.date   != "Unknown Date";
+	}
+
+	// Found art cached under any of `keys`, preferring a fresh entry
+	// over a stale one
+	std::optional<ArtCacheEntry> best_hit(const std::vector<std::string>& keys) {
+		std::optional<ArtCacheEntry> stale;
+		for (const auto& key : keys) {
+			auto hit = art_cache_get(key);
+			if (!hit || hit->urls.cover_url.empty()) continue;
+			if (!hit->stale) return hit;
+			if (!stale) stale = std::move(hit);
+		}
+		return stale;
+	}
+
+	// Found art cached under any key this job could resolve through: the
+	// exact tagged release (or group) first, then the album index
+	std::optional<ArtCacheEntry> cached_art(const ArtJob& job) {
+		std::vector<std::string> keys;
+		if (!job.mbAlbumID.empty())
+			keys.push_back(art_cache_release_key(job.mbAlbumID));
+		if (!job.mbReleaseGroupID.empty())
+			keys.push_back(art_cache_release_group_key(job.mbReleaseGroupID));
+		for (auto& key : album_keys(job)) keys.push_back(std::move(key));
+		const std::string fp = job.fingerprint.empty()
+			? getMPDCachedFingerprint(job.uri) : job.fingerprint;
+		if (!fp.empty())
+			keys.push_back(art_cache_fingerprint_key(fp, job.duration));
+		if (searchable(job))
+			keys.push_back(art_cache_album_key(job.artist, job.album, job.date));
+		return best_hit(keys);
+	}
+
+	// What a refresh is deduplicated by: the album, as specifically as the
+	// job identifies it
+	std::string revalidate_key(const ArtJob& job) {
+		std::vector<std::string> keys = album_keys(job);
+		if (!keys.empty()) return std::move(keys.front());
+		if (!job.fingerprint.empty()) return art_cache_fingerprint_key(job.fingerprint, job.duration);
+		if (searchable(job)) return art_cache_album_key(job.artist, job.album, job.date);
+		return job.uri;
+	}
+
+	// Look a stale entry up again once nothing more urgent is queued
+	void schedule_revalidate(ArtJob job) {
+		job.prefetch   = true;
+		job.revalidate = true;
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			if (revalidateQueue.size() >= MAX_REVALIDATE_JOBS) return;
+			if (!revalidating.insert(revalidate_key(job)).second) return;
+			revalidateQueue.push_back(std::move(job));
+		}
+		workAvailable.release();
+	}
+
+	// Whether `method` has what it needs for this job
+	bool applicable(const std::string& method, const ArtJob& job) {
+		if (method == "tags")
+			return !job.mbAlbumID.empty() || !job.mbReleaseGroupID.empty();
+		if (method == "fingerprint")
+			return !job.fingerprint.empty() ||
+				(!job.uri.empty() && classifyMPDUri(job.uri) == MPDSource::File);
+		if (method == "search")
+			return searchable(job);
+		return false;
+	}
+
+	// Run one art method to completion on the calling thread
+	AlbumUrls run_method(const std::string& method, ArtJob job,
+			Clock::time_point deadline, const std::atomic<bool>& cancel) {
+		HttpRequestScope scope(
+				job.prefetch ? HttpPriority::Prefetch : HttpPriority::Current,
+				std::max<Clock::duration>(deadline - Clock::now(), std::chrono::milliseconds(1)),
+				&cancel);
+
+		AlbumUrls urls;
+		if (method == "tags") {
+			urls = get_album_urls_tags(job.mbAlbumID, job.mbReleaseGroupID);
+		} else if (method == "fingerprint") {
+			if (job.fingerprint.empty())
+				job.fingerprint = getMPDFingerprintFor(job.uri,
+						[&] { return cancel.load() || abandoned(job); });
+			if (!job.fingerprint.empty())
+				urls = get_album_urls_fingerprint(
+						job.duration, job.fingerprint, "2jFwlOUpO2");
+		} else if (method == "search") {
+			urls = get_album_urls_search(job.artist, job.album, job.date, 100);
+		}
+
+		if (!urls.cover_url.empty())
+			LOG_INFO("Album art: " << method << " succeeded");
+		return urls;
+	}
+
+	// One method of a resolve() race
+	struct MethodRun {
+		std::string            method;
+		std::future<AlbumUrls> future;
+		bool                   started = false;
+		bool                   done    = false;
+		AlbumUrls              urls;
+		Clock::time_point      finishedAt;
+
+		bool failed() const { return done && urls.cover_url.empty(); }
+	};
+
+	// Resolve art with the configured methods racing each other. The first
+	// method starts at once and each further one is hedged in after
+	// `hedge_delay` ms (or as soon as everything started so far has failed).
+	// The result of the most preferred method wins: a later method's hit is
+	// taken once every earlier method failed, or after PREFERENCE_GRACE.
+	// Past the per-job deadline everything is cancelled and the placeholder
+	// stays.
+	AlbumUrls resolve(const ArtJob& job) {
+		if (!job.revalidate) {
+			if (auto hit = cached_art(job)) {
+				LOG_INFO("Album art: cache hit" << (hit->stale ? " (stale, refreshing)" : ""));
+				if (hit->stale) schedule_revalidate(job);
+				return hit->urls;
+			}
+		}
+
+		// Declared before the runs: their futures wait for the method
+		// threads, which read it, when resolve() returns
+		std::atomic<bool> cancel{false};
+
+		std::vector<MethodRun> runs;
+		for (const auto& method : methods)
+			if (applicable(method, job)) {
+				runs.emplace_back();
+				runs.back().method = method;
+			}
+		if (runs.empty()) return {};
+
+		const auto start    = Clock::now();
+		const auto hedge    = std::chrono::milliseconds(std::max(0, g_config.getHedgeDelay()));
+		const auto deadline = start + (job.prefetch ? PREFETCH_JOB_BUDGET
+				: std::chrono::seconds(std::max(1, g_config.getArtTimeout())));
+
+		auto launch = [&](MethodRun& run) {
+			run.started = true;
+			run.future  = std::async(std::launch::async, run_method,
+					run.method, job, deadline, std::cref(cancel));
+			LOG_DEBUG("Album art: starting " << run.method << " after "
+					<< std::chrono::duration_cast<std::chrono::milliseconds>(
+						Clock::now() - start).count() << " ms");
+		};
+
+		AlbumUrls urls;
+		auto nextLaunch = start;
+		while (true) {
+			const auto now = Clock::now();
+
+			for (auto& run : runs) {
+				if (run.started && !run.done &&
+						run.future.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+					run.done       = true;
+					run.urls       = run.future.get();
+					run.finishedAt = now;
+				}
+			}
+
+			// Hedge in the next method when due, or right away once all
+			// started ones have failed
+			auto next = std::find_if(runs.begin(), runs.end(),
+					[](const MethodRun& r) { return !r.started; });
+			const bool allFailed = std::all_of(runs.begin(), next,
+					[](const MethodRun& r) { return r.failed(); });
+			if (next != runs.end() && (now >= nextLaunch || allFailed)) {
+				launch(*next);
+				nextLaunch = now + hedge;
+			}
+
+			// Most preferred method that has not failed
+			auto best = std::find_if(runs.begin(), runs.end(),
+					[](const MethodRun& r) { return !r.failed(); });
+			if (best == runs.end()) break;
+			if (best->done) {
+				urls = best->urls;
+				break;
+			}
+
+			// A less preferred hit waits a little for the better method
+			auto hit = std::find_if(best, runs.end(),
+					[](const MethodRun& r) { return r.done && !r.failed(); });
+			if (hit != runs.end() && now - hit->finishedAt >= PREFERENCE_GRACE) {
+				LOG_DEBUG("Album art: not waiting for " << best->method
+						<< ", using " << hit->method);
+				urls = hit->urls;
+				break;
+			}
+
+			if (now >= deadline) {
+				LOG_INFO("Album art: no result within the deadline, giving up");
+				break;
+			}
+			if (abandoned(job)) break;
+
+			if (best->started)
+				best->future.wait_for(RACE_POLL);
+			else
+				std::this_thread::sleep_for(RACE_POLL);
+		}
+
+		if (!urls.cover_url.empty()) record_album(job, urls);
+
+		// Stop the losers; their futures wait for them to unwind below
+		cancel = true;
+		return urls;
+	}
+
+	ArtResult make_result(int songID, const AlbumUrls& urls) {
+		ArtResult result{songID, urls.cover_url, urls.page_url, {}, {}};
+
+		// Show "View Album" only if config Button1 is set and art was found
+		if (!g_config.getButton1Label().empty() && !g_config.getButton1Url().empty() &&
+				!urls.page_url.empty()) {
+			result.btnLabel = "View Album";
+			result.btnUrl   = urls.page_url;
+		}
+		return result;
+	}
+
+	void publish(const ArtJob& job, const AlbumUrls& urls) {
+		if (urls.cover_url.empty()) {
+			LOG_DEBUG("No album art for song " << job.songID << ", keeping placeholder");
+			return;
+		}
+
+		results.push_drop_oldest(make_result(job.songID, urls));
+		event_loop_wake();
+	}
+
+	// The current track always goes before prefetches, and those before
+	// refreshing stale entries. Of several queued tracks only the newest is
+	// still worth resolving.
+	std::optional<ArtJob> next_job() {
+		std::optional<ArtJob> job;
+		while (auto newer = tracks.try_pop()) {
+			if (job) superseded.fetch_add(1, std::memory_order_relaxed);
+			job = std::move(newer);
+		}
+		if (job) return job;
+
+		std::lock_guard<std::mutex> lock(queueMutex);
+		std::deque<ArtJob>& from = !prefetchQueue.empty() ? prefetchQueue : revalidateQueue;
+		if (from.empty()) return std::nullopt;
+		job = std::move(from.front());
+		from.pop_front();
+		return job;
+	}
+
+	void run() {
+		while (running) {
+			std::optional<ArtJob> next = next_job();
+			if (!next) {
+				workAvailable.acquire();
+				continue;
+			}
+			ArtJob& job = *next;
+
+			if (job.revalidate) {
+				LOG_DEBUG("Refreshing stale album art for: " << job.artist << " - " << job.album);
+				resolve(job);
+				std::lock_guard<std::mutex> lock(queueMutex);
+				revalidating.erase(revalidate_key(job));
+			} else if (job.prefetch) {
+				LOG_DEBUG("Prefetching album art for: " << job.artist << " - " << job.album);
+				resolve(job);
+			} else if (is_stale(job)) {
+				LOG_DEBUG("Skipping stale art job for song " << job.songID);
+			} else {
+				publish(job, resolve(job));
+			}
+		}
+	}
+
+} // anonymous namespace
+
+void art_resolver_start(const std::vector<std::string>& m) {
+	if (running) return;
+	methods = m;
+	running = true;
+	worker  = std::thread(run);
+	LOG_DEBUG("Album art resolver started");
+}
+
+void art_resolver_stop() {
+	if (!running.exchange(false)) return;
+	workAvailable.release();
+	if (worker.joinable()) worker.join();
+
+	while (tracks.try_pop()) {}
+	std::lock_guard<std::mutex> lock(queueMutex);
+	prefetchQueue.clear();
+	revalidateQueue.clear();
+	revalidating.clear();
+	LOG_DEBUG("Album art resolver stopped");
+}
+
+void art_resolver_submit(ArtJob job) {
+	tracks.push_drop_oldest(std::move(job));
+	workAvailable.release();
+}
+
+bool art_resolver_cached(const ArtJob& job, ArtResult& out) {
+	auto hit = cached_art(job);
+	if (!hit || hit->stale) return false;
+	out = make_result(job.songID, hit->urls);
+	return true;
+}
+
+bool art_resolver_take_result(ArtResult& out) {
+	std::optional<ArtResult> result = results.try_pop();
+	if (!result) return false;
+	out = std::move(*result);
+	return true;
+}
+
+void art_resolver_log_stats() {
+	auto log_one = [](const char* name, const auto& queue, uint64_t superseded) {
+		const auto st = queue.stats();
+		LOG_INFO("Queue " << name << ": depth " << st.depth << ", peak " << st.peak
+				<< ", " << st.pushed << " pushed, " << st.dropped + superseded << " dropped");
+	};
+	log_one("tracks", tracks, superseded.load(std::memory_order_relaxed));
+	log_one("art-results", results, 0);
+
+	std::lock_guard<std::mutex> lock(queueMutex);
+	LOG_INFO("Queue prefetch: depth " << prefetchQueue.size()
+			<< ", revalidate: depth " << revalidateQueue.size());
+}
+
+void art_resolver_prefetch(std::vector<ArtJob> jobs) {
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		prefetchQueue.clear();
+		for (auto& job : jobs) {
+			job.prefetch = true;
+			prefetchQueue.push_back(std::move(job));
+		}
+	}
+	workAvailable.release();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Everything the background resolver needs to look up art for one track.
+// Captured on the main thread so the worker never touches MPD state; the
+// fingerprint is computed by the worker (on its own MPD connection) only
+// when the `fingerprint` method is actually reached.
+struct ArtJob {
+	int         songID   = -1;
+	int         duration = 0;
+	std::string uri;
+	std::string artist;
+	std::string album;
+	std::string albumArtist;
+	std::string date;
+	std::string mbAlbumID;
+	std::string mbReleaseGroupID;
+	std::string fingerprint;
+	bool        prefetch = false; // only warm the caches, never publish
+	bool        revalidate = false; // refresh stale cached art, skip the cache
+};
+
+// Art found for the current track, on its way from the worker to the main
+// thread, which applies it to the presence (see art_resolver_take_result).
+struct ArtResult {
+	int         songID = -1;
+	std::string cover_url;
+	std::string page_url;
+	std::string btnLabel;
+	std::string btnUrl;
+};
+
+// Start the worker thread. `methods` is the configured method_order.
+void art_resolver_start(const std::vector<std::string>& methods);
+
+// Stop the worker; an in-flight lookup is abandoned at the next check.
+void art_resolver_stop();
+
+// Queue a lookup for a new track. Any queued job for an older track is
+// dropped; a running one bails out as soon as it notices the song changed.
+// Never blocks.
+void art_resolver_submit(ArtJob job);
+
+// Fresh art for `job` that is already cached, found without any network
+// I/O. Lets a track change push the cover of a prefetched song together
+// with its text instead of in a second, rate-limited update. Stale
+// entries do not count; the resolver refreshes those.
+bool art_resolver_cached(const ArtJob& job, ArtResult& out);
+
+// Take the next finished lookup, if any. Main thread only: the worker
+// calls event_loop_wake() whenever it queues one.
+bool art_resolver_take_result(ArtResult& out);
+
+// Log depth, peak and drop counters of the resolver's queues.
+void art_resolver_log_stats();
+
+// Stale cached art is returned immediately and refreshed by a background
+// job that runs after current-track and prefetch work.
+
+// Queue low-priority lookups for upcoming songs. They run only when no
+// current-track job is waiting, replace any earlier prefetch batch, and
+// just populate the caches so the track change finds its art immediately.
+void art_resolver_prefetch(std::vector<ArtJob> jobs);
@@ -94,6 +94,21 @@ std::string Config::getAlbumArtMethodOrder() const {
 	return getValue("method_order");
 }
 
+int Config::getPrefetchCount() const {
+	std::string countStr = getValue("prefetch");
+	return countStr.empty() ? 2 : std::stoi(countStr);
+}
+
+int Config::getHedgeDelay() const {
+	std::string delayStr = getValue("hedge_delay");
+	return delayStr.empty() ? 1500 : std::stoi(delayStr);
+}
+
+int Config::getArtTimeout() const {
+	std::string timeoutStr = getValue("art_timeout");
+	return timeoutStr.empty() ? 20 : std::stoi(timeoutStr);
+}
+
 std::string Config::getButton1Label() const {
 	return getValue("Button1Label");
 }
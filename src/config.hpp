@@ -18,6 +18,9 @@ class Config {
 		std::string getPassword() const;
 		std::string getMusicFolder() const;
 		std::string getAlbumArtMethodOrder() const;
+		int getPrefetchCount() const;
+		int getHedgeDelay() const;
+		int getArtTimeout() const;
 
 		std::string getButton1Label() const;
 		std::string getButton1Url() const;
@@ -0,0 +1,165 @@
+#include "event_loop.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+#include "logger.hpp"
+
+namespace {
+	// Tags stored in epoll_event.data to tell the sources apart
+	enum Source : uint64_t { SRC_FD, SRC_TIMER, SRC_SIGNAL, SRC_WAKE };
+
+	// Created on first use; the wake fd exists from static initialisation
+	// so event_loop_wake() never has to create anything
+	int epollFd  = -1;
+	int timerFd  = -1;
+	int signalFd = -1;
+	int wakeFd   = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	// The caller's fd as currently registered
+	int watchedFd = -1;
+
+	std::atomic<int> lastSignal{0};
+
+	void add(int fd, uint64_t tag) {
+		epoll_event ev{};
+		ev.events   = EPOLLIN;
+		ev.data.u64 = tag;
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0)
+			LOG_ERR("epoll_ctl(ADD) failed: " << strerror(errno));
+	}
+
+	bool ensure_init() {
+		if (epollFd >= 0) return true;
+
+		epollFd = epoll_create1(EPOLL_CLOEXEC);
+		timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+		if (epollFd < 0 || timerFd < 0 || wakeFd < 0) {
+			LOG_ERR("Failed to create event loop: " << strerror(errno));
+			return false;
+		}
+		add(timerFd, SRC_TIMER);
+		add(wakeFd,  SRC_WAKE);
+		return true;
+	}
+
+	// Point the SRC_FD registration at `fd`. epoll forgets an fd once it is
+	// closed, and a reconnect can get the same number back, so the
+	// registration is refreshed on every wait rather than trusted.
+	void watch(int fd, uint32_t events) {
+		if (watchedFd >= 0 && fd != watchedFd)
+			epoll_ctl(epollFd, EPOLL_CTL_DEL, watchedFd, nullptr); // may already be gone
+		watchedFd = -1;
+		if (fd < 0) return;
+
+		epoll_event ev{};
+		ev.events   = events;
+		ev.data.u64 = SRC_FD;
+		if (epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+				epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			LOG_ERR("epoll_ctl on fd " << fd << " failed: " << strerror(errno));
+			return;
+		}
+		watchedFd = fd;
+	}
+
+	// Empty a counter fd (eventfd/timerfd) so it stops reporting readable
+	void drain(int fd) {
+		uint64_t value;
+		while (read(fd, &value, sizeof(value)) > 0) {}
+	}
+}
+
+bool event_loop_take_signals() {
+	if (!ensure_init()) return false;
+
+	sigset_t mask;
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGHUP);
+
+	signalFd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (signalFd < 0) {
+		LOG_ERR("signalfd() failed: " << strerror(errno));
+		return false;
+	}
+	if (pthread_sigmask(SIG_BLOCK, &mask, nullptr) != 0) {
+		LOG_ERR("Failed to block termination signals");
+		close(signalFd);
+		signalFd = -1;
+		return false;
+	}
+	add(signalFd, SRC_SIGNAL);
+	return true;
+}
+
+void event_loop_set_timer(int ms) {
+	if (!ensure_init()) return;
+
+	itimerspec spec{};
+	if (ms >= 0) {
+		// An all-zero it_value disarms, so "now" is one nanosecond
+		spec.it_value.tv_sec  = ms / 1000;
+		spec.it_value.tv_nsec = ms % 1000 * 1000000L + (ms == 0 ? 1 : 0);
+	}
+	timerfd_settime(timerFd, 0, &spec, nullptr);
+}
+
+unsigned event_loop_wait(int fd, uint32_t fdEvents, int timeoutMs) {
+	if (!ensure_init()) return LOOP_TIMEOUT;
+	watch(fd, fdEvents);
+
+	epoll_event events[4];
+	const int n = epoll_wait(epollFd, events, 4, timeoutMs);
+	if (n < 0) {
+		if (errno != EINTR) LOG_ERR("epoll_wait() failed: " << strerror(errno));
+		return LOOP_TIMEOUT;
+	}
+	if (n == 0) return LOOP_TIMEOUT;
+
+	unsigned ready = LOOP_NONE;
+	for (int i = 0; i < n; ++i) {
+		switch (events[i].data.u64) {
+			case SRC_FD:
+				ready |= LOOP_FD;
+				break;
+			case SRC_TIMER:
+				drain(timerFd);
+				ready |= LOOP_TIMER;
+				break;
+			case SRC_WAKE:
+				drain(wakeFd);
+				ready |= LOOP_WAKE;
+				break;
+			case SRC_SIGNAL: {
+				signalfd_siginfo info;
+				while (read(signalFd, &info, sizeof(info)) == sizeof(info))
+					lastSignal = static_cast<int>(info.ssi_signo);
+				ready |= LOOP_SIGNAL;
+				break;
+			}
+		}
+	}
+	return ready;
+}
+
+int event_loop_last_signal() {
+	return lastSignal;
+}
+
+void event_loop_wake() {
+	const uint64_t one = 1;
+	if (wakeFd >= 0) {
+		ssize_t r = write(wakeFd, &one, sizeof(one));
+		(void)r;
+	}
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+// The main thread's reactor: one epoll set over
+//   - one caller-supplied fd (the MPD connection, or a socket that is
+//     still connecting),
+//   - a one-shot timerfd for deferred work (rate-limited presence pushes,
+//     throttled stream titles),
+//   - a signalfd for SIGINT/SIGTERM/SIGHUP, once event_loop_take_signals()
+//     has been called,
+//   - an eventfd that other threads poke via event_loop_wake().
+// Nothing wakes the process unless one of these fires.
+
+// What ended an event_loop_wait()
+enum LoopReady : unsigned {
+	LOOP_NONE    = 0,
+	LOOP_FD      = 1u << 0, // the watched fd is ready (or hung up)
+	LOOP_TIMER   = 1u << 1, // the event_loop_set_timer() timer expired
+	LOOP_SIGNAL  = 1u << 2, // a terminating signal arrived
+	LOOP_WAKE    = 1u << 3, // event_loop_wake() was called
+	LOOP_TIMEOUT = 1u << 4, // the wait's own timeout expired
+};
+
+// Block SIGINT, SIGTERM and SIGHUP and receive them through the loop
+// instead of a handler. Call before starting any thread so every thread
+// inherits the mask. Returns false if the signalfd cannot be created.
+bool event_loop_take_signals();
+
+// Arm the one-shot timer to fire in `ms` milliseconds (0 = right away);
+// a negative value disarms it. Replaces any earlier setting.
+void event_loop_set_timer(int ms);
+
+// Wait until `fd` (if >= 0) reports any of `fdEvents` (EPOLLIN, EPOLLOUT),
+// the timer fires, a signal or wake-up arrives, or `timeoutMs` passes
+// (-1 = no timeout). Returns a mask of LoopReady flags.
+unsigned event_loop_wait(int fd, uint32_t fdEvents, int timeoutMs);
+
+// Signal number behind the last LOOP_SIGNAL (0 if none yet)
+int event_loop_last_signal();
+
+// Wake a blocked event_loop_wait(). Any thread; async-signal-safe.
+void event_loop_wake();
@@ -0,0 +1,354 @@
+#include "http_client.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "logger.hpp"
+
+namespace {
+
+	// One lock per kind of shared data, as curl asks for
+	std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+	void share_lock(CURL*, curl_lock_data data, curl_lock_access, void*) {
+		shareLocks[data].lock();
+	}
+
+	void share_unlock(CURL*, curl_lock_data data, void*) {
+		shareLocks[data].unlock();
+	}
+
+	CURLSH* shared_handle() {
+		static CURLSH* share = [] {
+			curl_global_init(CURL_GLOBAL_DEFAULT);
+			CURLSH* sh = curl_share_init();
+			if (!sh) return sh;
+			curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, share_lock);
+			curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, share_unlock);
+			curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+			curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+			curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+			return sh;
+		}();
+		return share;
+	}
+
+	size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* out)
+	{
+		size_t totalSize = size * nmemb;
+		out->append(static_cast<char*>(contents), totalSize);
+		return totalSize;
+	}
+
+	// Thread-local handles are cleaned up when their thread exits
+	struct EasyHandle {
+		CURL* h = curl_easy_init();
+		~EasyHandle() { if (h) curl_easy_cleanup(h); }
+	};
+
+	struct MultiHandle {
+		CURLM* h = nullptr;
+		MultiHandle() {
+			shared_handle();
+			h = curl_multi_init();
+			if (h) curl_multi_setopt(h, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+		}
+		~MultiHandle() { if (h) curl_multi_cleanup(h); }
+	};
+
+	struct HostStats {
+		long requests       = 0;
+		long newConnections = 0;
+	};
+
+	std::mutex                       statsMutex;
+	std::map<std::string, HostStats> hostStats;
+
+	std::string host_of(const std::string& u) {
+		size_t start = u.find("://");
+		start = (start == std::string::npos) ? 0 : start + 3;
+		size_t end = u.find_first_of(":/?", start);
+		return u.substr(start, end == std::string::npos ? std::string::npos : end - start);
+	}
+
+	// ── Rate limiter ──
+
+	using Clock = std::chrono::steady_clock;
+
+	constexpr long DEFAULT_TIMEOUT_MS = 5000;
+
+	struct HostLimit {
+		const char* host;
+		double      rate;  // requests per second
+		double      burst;
+	};
+
+	// Published upstream limits; other hosts are only paused by Retry-After
+	constexpr HostLimit HOST_LIMITS[] = {
+		{ "musicbrainz.org",  1.0, 1.0 },
+		{ "api.acoustid.org", 3.0, 3.0 },
+	};
+
+	constexpr int PRIORITY_COUNT = 3;
+
+	struct Bucket {
+		double            rate   = 0.0; // 0 = unlimited
+		double            burst  = 0.0;
+		double            tokens = 0.0;
+		Clock::time_point refilled;
+		Clock::time_point blockedUntil; // set from Retry-After
+		int               waiting[PRIORITY_COUNT] = {};
+	};
+
+	std::mutex                    schedMutex;
+	std::condition_variable       schedCv;
+	std::map<std::string, Bucket> buckets;
+
+	thread_local HttpPriority              tlPriority = HttpPriority::Current;
+	thread_local Clock::time_point         tlDeadline = Clock::time_point::max();
+	thread_local const std::atomic<bool>*  tlCancel   = nullptr;
+
+	// How often a waiting request looks at its cancel flag
+	constexpr auto CANCEL_CHECK = std::chrono::milliseconds(100);
+
+	// Progress callback: a non-zero return aborts the transfer
+	int cancel_callback(void* flag, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+		return static_cast<const std::atomic<bool>*>(flag)->load() ? 1 : 0;
+	}
+
+	// Must be called with schedMutex held
+	Bucket& bucket_for(const std::string& host) {
+		auto it = buckets.find(host);
+		if (it != buckets.end()) return it->second;
+
+		Bucket b;
+		for (const auto& limit : HOST_LIMITS) {
+			if (host == limit.host) {
+				b.rate   = limit.rate;
+				b.burst  = limit.burst;
+				b.tokens = limit.burst;
+			}
+		}
+		b.refilled = Clock::now();
+		return buckets.emplace(host, b).first->second;
+	}
+
+	void block_host(const std::string& host, Clock::duration wait) {
+		std::lock_guard<std::mutex> lock(schedMutex);
+		Bucket& b = bucket_for(host);
+		b.blockedUntil = std::max(b.blockedUntil, Clock::now() + wait);
+		schedCv.notify_all();
+	}
+
+} // anonymous namespace
+
+HttpRequestScope::HttpRequestScope(HttpPriority priority, Clock::duration budget,
+		const std::atomic<bool>* cancel)
+	: prevPriority_(tlPriority), prevDeadline_(tlDeadline), prevCancel_(tlCancel)
+{
+	tlPriority = priority;
+	if (budget > Clock::duration::zero())
+		tlDeadline = std::min(tlDeadline, Clock::now() + budget);
+	if (cancel) tlCancel = cancel;
+}
+
+HttpRequestScope::~HttpRequestScope() {
+	tlPriority = prevPriority_;
+	tlDeadline = prevDeadline_;
+	tlCancel   = prevCancel_;
+}
+
+bool http_cancelled() {
+	return tlCancel && tlCancel->load();
+}
+
+bool http_abandoned() {
+	return http_cancelled() || Clock::now() >= tlDeadline;
+}
+
+bool http_acquire(const std::string& url) {
+	const std::string host = host_of(url);
+	const int prio = static_cast<int>(tlPriority);
+
+	std::unique_lock<std::mutex> lock(schedMutex);
+	Bucket& b = bucket_for(host);
+	b.waiting[prio]++;
+
+	auto leave = [&](bool admitted) {
+		b.waiting[prio]--;
+		schedCv.notify_all(); // lower priorities may now go
+		return admitted;
+	};
+
+	while (true) {
+		if (http_cancelled()) return leave(false);
+
+		const auto now = Clock::now();
+		if (b.rate > 0) {
+			const double elapsed = std::chrono::duration<double>(now - b.refilled).count();
+			b.tokens   = std::min(b.burst, b.tokens + elapsed * b.rate);
+			b.refilled = now;
+		}
+
+		bool higherWaiting = false;
+		for (int q = 0; q < prio; ++q) higherWaiting |= (b.waiting[q] > 0);
+
+		const bool blocked = now < b.blockedUntil;
+		if (!blocked && !higherWaiting && (b.rate <= 0 || b.tokens >= 1.0)) {
+			if (b.rate > 0) b.tokens -= 1.0;
+			return leave(true);
+		}
+
+		// When could we go next (ignoring other waiters)?
+		Clock::time_point wake = now + std::chrono::seconds(1);
+		if (blocked)
+			wake = b.blockedUntil;
+		else if (b.rate > 0 && b.tokens < 1.0)
+			wake = now + std::chrono::duration_cast<Clock::duration>(
+					std::chrono::duration<double>((1.0 - b.tokens) / b.rate));
+
+		if (now >= tlDeadline || (!higherWaiting && wake > tlDeadline)) {
+			LOG_DEBUG("Request to " << host << " dropped: deadline before rate limit allows it");
+			return leave(false);
+		}
+
+		wake = std::min(wake, tlDeadline);
+		if (tlCancel) wake = std::min(wake, now + CANCEL_CHECK);
+		schedCv.wait_until(lock, wake);
+	}
+}
+
+long http_timeout_ms() {
+	if (tlDeadline == Clock::time_point::max()) return DEFAULT_TIMEOUT_MS;
+	const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+			tlDeadline - Clock::now()).count();
+	return std::clamp<long>(left, 1, DEFAULT_TIMEOUT_MS);
+}
+
+void http_setup_handle(CURL* easy) {
+	curl_easy_setopt(easy, CURLOPT_SHARE, shared_handle());
+	curl_easy_setopt(easy, CURLOPT_USERAGENT, "MPD-Presence");
+	curl_easy_setopt(easy, CURLOPT_TIMEOUT_MS, http_timeout_ms());
+	curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L); // required when used from threads
+	curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(easy, CURLOPT_HTTP_VERSION, static_cast<long>(CURL_HTTP_VERSION_2TLS));
+	curl_easy_setopt(easy, CURLOPT_PIPEWAIT, 1L); // prefer multiplexing over a new connection
+	if (tlCancel) {
+		curl_easy_setopt(easy, CURLOPT_XFERINFOFUNCTION, cancel_callback);
+		curl_easy_setopt(easy, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(tlCancel));
+		curl_easy_setopt(easy, CURLOPT_NOPROGRESS, 0L);
+	}
+}
+
+CURLM* http_multi() {
+	thread_local MultiHandle multi;
+	return multi.h;
+}
+
+void http_record_transfer(CURL* easy) {
+	const char* url = nullptr;
+	long connects = 0;
+	long status = 0;
+	curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_URL, &url);
+	curl_easy_getinfo(easy, CURLINFO_NUM_CONNECTS, &connects);
+	curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &status);
+
+	// Throttled: pause this host for as long as it asks (at least 1 s)
+	if (status == 429 || status == 503) {
+		curl_off_t retryAfter = 0;
+		curl_easy_getinfo(easy, CURLINFO_RETRY_AFTER, &retryAfter);
+		const long seconds = std::max<long>(1, static_cast<long>(retryAfter));
+		LOG_WARN("HTTP " << status << " from " << host_of(url ? url : "?")
+				<< " -- pausing requests for " << seconds << "s");
+		block_host(host_of(url ? url : "?"), std::chrono::seconds(seconds));
+	}
+
+	std::lock_guard<std::mutex> lock(statsMutex);
+	HostStats& hs = hostStats[host_of(url ? url : "?")];
+	hs.requests++;
+	hs.newConnections += connects;
+}
+
+namespace {
+
+	// GET, or POST when `body` is given. Retried after a 429/503 while the
+	// deadline allows.
+	HttpResponse perform(const std::string& url, const std::string* body,
+			const std::vector<std::string>& headers)
+	{
+		// Per-thread handle: reset keeps its connection/DNS state, and the
+		// share object makes that state common to all threads anyway
+		thread_local EasyHandle handle;
+		CURL* curl = handle.h;
+
+		HttpResponse response;
+		if (!curl) {
+			response.result = CURLE_FAILED_INIT;
+			return response;
+		}
+
+		curl_slist* headerList = nullptr;
+		for (const auto& h : headers) headerList = curl_slist_append(headerList, h.c_str());
+
+		constexpr int MAX_ATTEMPTS = 3;
+		for (int attempt = 1; attempt <= MAX_ATTEMPTS; ++attempt) {
+			response = {};
+			if (!http_acquire(url)) {
+				response.result = CURLE_OPERATION_TIMEDOUT;
+				break;
+			}
+
+			curl_easy_reset(curl);
+			http_setup_handle(curl);
+			curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+			curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+			curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+			if (headerList) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headerList);
+			if (body) {
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->data());
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE,
+						static_cast<curl_off_t>(body->size()));
+			}
+
+			response.result = curl_easy_perform(curl);
+			if (response.result == CURLE_OK)
+				curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response.status);
+
+			http_record_transfer(curl);
+
+			// Throttled: the host is now paused, so the next acquire waits out
+			// Retry-After (or gives up if that would miss the deadline)
+			if (response.status != 429 && response.status != 503) break;
+			if (http_cancelled()) break;
+		}
+
+		curl_slist_free_all(headerList);
+		return response;
+	}
+
+} // anonymous namespace
+
+HttpResponse http_get(const std::string& url) {
+	return perform(url, nullptr, {});
+}
+
+HttpResponse http_post(const std::string& url, const std::string& body,
+		const std::vector<std::string>& headers)
+{
+	return perform(url, &body, headers);
+}
+
+void http_log_stats() {
+	std::lock_guard<std::mutex> lock(statsMutex);
+	for (const auto& [host, hs] : hostStats) {
+		long reused = hs.requests - hs.newConnections;
+		if (reused < 0) reused = 0;
+		LOG_INFO("HTTP " << host << ": " << hs.requests << " requests, "
+				<< hs.newConnections << " new connections, "
+				<< (hs.requests ? reused * 100 / hs.requests : 0) << "% reused");
+	}
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+// Shared HTTP layer used by every outbound request.
+//
+// All easy handles are attached to one curl share object, so DNS lookups,
+// TLS sessions and open connections are reused across requests and threads.
+// Connections are kept alive and negotiate HTTP/2 where the server offers it,
+// letting concurrent transfers on a multi handle share one connection.
+//
+// Every request also passes through a per-host token bucket scheduler
+// (MusicBrainz 1 req/s, AcoustID 3 req/s). Waiting requests are served by
+// priority, a 429/503 with Retry-After pauses the host, and a request that
+// cannot start before its deadline fails instead of queueing forever.
+
+// Priority classes, highest first
+enum class HttpPriority { Current, Prefetch, Bulk };
+
+// Priority and time budget for every request made by this thread while the
+// scope is alive. A zero budget means no deadline. Scopes nest.
+//
+// Setting `*cancel` (from any thread) makes waiting requests give up and
+// aborts running transfers within about a second.
+class HttpRequestScope {
+	public:
+		explicit HttpRequestScope(HttpPriority priority,
+				std::chrono::steady_clock::duration budget = {},
+				const std::atomic<bool>* cancel = nullptr);
+		~HttpRequestScope();
+
+		HttpRequestScope(const HttpRequestScope&) = delete;
+		HttpRequestScope& operator=(const HttpRequestScope&) = delete;
+
+	private:
+		HttpPriority                          prevPriority_;
+		std::chrono::steady_clock::time_point prevDeadline_;
+		const std::atomic<bool>*              prevCancel_;
+};
+
+// True once this thread's requests have been cancelled (see above). Failures
+// caused by cancelling say nothing about the resource and must not be cached.
+bool http_cancelled();
+
+// True once this thread's requests are cancelled or its deadline has
+// passed. A request that failed then was cut short by the caller, not
+// answered by the server.
+bool http_abandoned();
+
+struct HttpResponse {
+	CURLcode    result = CURLE_OK;
+	long        status = 0;
+	std::string body;
+};
+
+// Apply the shared defaults (share handle, user agent, timeout, keep-alive,
+// HTTP/2) to a fresh or reset easy handle.
+void http_setup_handle(CURL* easy);
+
+// Per-thread multi handle for concurrent transfers, with multiplexing on.
+CURLM* http_multi();
+
+// Wait for the rate limiter to admit a request to this URL's host.
+// Returns false if the thread's deadline would pass first.
+bool http_acquire(const std::string& url);
+
+// Remaining time before this thread's deadline, capped to the default
+// 5 s transfer timeout. Used for CURLOPT_TIMEOUT_MS.
+long http_timeout_ms();
+
+// Record connection reuse and Retry-After for a finished transfer.
+void http_record_transfer(CURL* easy);
+
+// Blocking GET on a per-thread handle, retried after a 429/503 while the
+// deadline allows. Rate limited like every other request.
+HttpResponse http_get(const std::string& url);
+
+// Blocking POST of a raw body with extra request headers; same policy.
+HttpResponse http_post(const std::string& url, const std::string& body,
+		const std::vector<std::string>& headers);
+
+// Log per-host request and connection reuse counters.
+void http_log_stats();
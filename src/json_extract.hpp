@@ -0,0 +1,173 @@
+#pragma once
+
+#include <chrono>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "logger.hpp"
+
+// Streaming extraction of the few fields we use from MusicBrainz/AcoustID
+// responses. They are parsed with nlohmann's SAX interface instead of
+// building a DOM: we only need a couple of fields per release, so nothing
+// else is ever allocated, and the parse stops as soon as the extractor has
+// what it needs. (bench/parse_bench.cpp compares this against the DOM.)
+
+// Tracks the container path and hands scalars to the subclass.
+// Returning false from a hook stops parsing (that is not an error).
+class PathSax : public nlohmann::json_sax<nlohmann::json> {
+	public:
+		bool failed = false;
+
+		bool null() override                               { return true; }
+		bool boolean(bool) override                        { return true; }
+		bool number_integer(number_integer_t v) override   { return onNumber(static_cast<double>(v)); }
+		bool number_unsigned(number_unsigned_t v) override { return onNumber(static_cast<double>(v)); }
+		bool number_float(number_float_t v, const string_t&) override { return onNumber(v); }
+		bool string(string_t& v) override                  { return onString(v); }
+		bool binary(binary_t&) override                    { return true; }
+
+		bool start_object(std::size_t) override { return enter(false); }
+		bool start_array(std::size_t) override  { return enter(true); }
+		bool end_object() override              { return leave(); }
+		bool end_array() override               { return leave(); }
+
+		bool key(string_t& k) override {
+			key_ = std::move(k);
+			return true;
+		}
+
+		bool parse_error(std::size_t, const std::string&,
+				const nlohmann::detail::exception& e) override {
+			LOG_ERR("JSON parsing error: " << e.what());
+			failed = true;
+			return false;
+		}
+
+	protected:
+		// How each open container was reached from its parent: the object
+		// key, or "#" for an array element. path_[0] is the root.
+		std::vector<std::string> path_;
+		std::string              key_; // key of the value being parsed
+
+		// Is the innermost open container reached by exactly these steps?
+		bool at(std::initializer_list<const char*> steps) const {
+			if (path_.size() != steps.size() + 1) return false;
+			size_t i = 1;
+			for (const char* step : steps)
+				if (path_[i++] != step) return false;
+			return true;
+		}
+
+		virtual bool onString(const std::string&) { return true; }
+		virtual bool onNumber(double)             { return true; }
+		virtual bool onLeave()                    { return true; } // container about to close
+
+	private:
+		std::vector<bool> isArray_;
+
+		bool enter(bool array) {
+			const bool element = !isArray_.empty() && isArray_.back();
+			path_.push_back(element ? "#" : key_);
+			isArray_.push_back(array);
+			return true;
+		}
+
+		bool leave() {
+			const bool keepGoing = onLeave();
+			path_.pop_back();
+			isArray_.pop_back();
+			return keepGoing;
+		}
+};
+
+// MusicBrainz search: `id`, `score` and release group of each top-level
+// release. Results come sorted by score, so we can stop at a perfect
+// match or at the first release below the threshold.
+class SearchSax : public PathSax {
+	public:
+		explicit SearchSax(double threshold) : threshold_(threshold) {}
+
+		std::string bestId;
+		std::string bestGroupId;
+		double      bestScore = -1.0;
+
+	protected:
+		bool onString(const std::string& v) override {
+			if (key_ == "id" && at({"releases", "#"})) id_ = v;
+			else if (key_ == "id" && at({"releases", "#", "release-group"})) groupId_ = v;
+			return true;
+		}
+
+		bool onNumber(double v) override {
+			if (key_ == "score" && at({"releases", "#"})) score_ = v;
+			return true;
+		}
+
+		bool onLeave() override {
+			if (!at({"releases", "#"})) return true;
+
+			const bool seen = !id_.empty() && score_ >= 0.0;
+			if (seen && score_ >= threshold_ && score_ > bestScore) {
+				bestScore   = score_;
+				bestId      = id_;
+				bestGroupId = groupId_;
+			}
+			const bool done = seen && (score_ >= 100.0 || score_ < threshold_);
+			id_.clear();
+			groupId_.clear();
+			score_ = -1.0;
+			return !done;
+		}
+
+	private:
+		double      threshold_;
+		std::string id_;
+		std::string groupId_;
+		double      score_ = -1.0;
+};
+
+// AcoustID lookup: `status` plus the release and release group IDs of
+// the first result. Releases are listed under the result, or under its
+// release groups when those are requested too.
+class AcoustIdSax : public PathSax {
+	public:
+		std::string              status;
+		bool                     hasResult = false;
+		std::vector<std::string> releaseIds;
+		std::vector<std::string> releaseGroupIds;
+
+	protected:
+		bool onString(const std::string& v) override {
+			if (key_ == "status" && at({})) {
+				status = v;
+			} else if (!hasResult && key_ == "id") {
+				if (at({"results", "#", "releases", "#"}) ||
+						at({"results", "#", "releasegroups", "#", "releases", "#"}))
+					releaseIds.push_back(v);
+				else if (at({"results", "#", "releasegroups", "#"}))
+					releaseGroupIds.push_back(v);
+			}
+			return !(hasResult && !status.empty());
+		}
+
+		// Only the best (first) result is used; stop after it unless
+		// `status` comes later in the document
+		bool onLeave() override {
+			if (at({"results", "#"})) hasResult = true;
+			return !(hasResult && !status.empty());
+		}
+};
+
+// Run a SAX extractor over a response; false on malformed JSON.
+// Logs how long the parse took so it can be compared at DEBUG level.
+inline bool sax_extract(const std::string& response, PathSax& sax) {
+	const auto start = std::chrono::steady_clock::now();
+	nlohmann::json::sax_parse(response, &sax);
+	const auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start).count();
+	LOG_DEBUG("Parsed " << response.size() << " bytes of JSON in " << us << " us");
+	return !sax.failed;
+}
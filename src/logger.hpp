@@ -103,9 +103,13 @@ class Logger {
 		}
 };
 
-/** Build a log message from a stream expression and emit it at the given level. **/
+/**
+ * Build a log message from a stream expression and emit it at the given
+ * level. Nothing is formatted (or allocated) for suppressed levels.
+ **/
 #define LOG_MSG(lvl, ...) \
 	do { \
+		if ((lvl) < Logger::get().level()) break; \
 		std::ostringstream _oss; \
 		_oss << __VA_ARGS__; \
 		Logger::get().log(lvl, __FILE__, __LINE__, _oss.str()); \
@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/** Approximate heap footprint of cached values, used for byte budgets. **/
+inline size_t cache_size_of(bool)                 { return sizeof(bool); }
+inline size_t cache_size_of(double)               { return sizeof(double); }
+inline size_t cache_size_of(const std::string& s) { return sizeof(s) + s.capacity(); }
+
+template <typename A, typename B>
+size_t cache_size_of(const std::pair<A, B>& p) {
+	return cache_size_of(p.first) + cache_size_of(p.second);
+}
+
+template <typename T>
+size_t cache_size_of(const std::vector<T>& v) {
+	size_t n = sizeof(v);
+	for (const auto& e : v) n += cache_size_of(e);
+	return n;
+}
+
+/**
+ * Bounded, thread-safe LRU cache with string keys, split into independently
+ * locked shards so concurrent lookups of different keys rarely contend.
+ *
+ * Limits are per cache (divided evenly between shards): a maximum number of
+ * entries and, optionally, a maximum number of bytes as estimated by
+ * cache_size_of(). The least recently used entry of a shard is evicted when
+ * either limit is exceeded.
+ *
+ * Lookups take a std::string_view, so callers never allocate a key just to
+ * probe the cache.
+ **/
+template <typename V, size_t Shards = 8>
+class ShardedLruCache {
+	public:
+		struct Stats {
+			uint64_t hits      = 0;
+			uint64_t misses    = 0;
+			uint64_t evictions = 0;
+			size_t   entries   = 0;
+			size_t   bytes     = 0;
+		};
+
+		/**
+		 * @param maxEntries  Entry limit for the whole cache.
+		 * @param maxBytes    Byte limit for the whole cache (0 = none).
+		 **/
+		explicit ShardedLruCache(size_t maxEntries, size_t maxBytes = 0)
+			: maxEntries_(std::max<size_t>(1, maxEntries / Shards)),
+			  maxBytes_(maxBytes / Shards) {}
+
+		ShardedLruCache(const ShardedLruCache&) = delete;
+		ShardedLruCache& operator=(const ShardedLruCache&) = delete;
+
+		/** Return a copy of the value and mark it most recently used. **/
+		std::optional<V> get(std::string_view key) {
+			Shard& s = shardFor(key);
+			std::lock_guard<std::mutex> lock(s.mu);
+			auto it = s.index.find(key);
+			if (it == s.index.end()) {
+				s.misses++;
+				return std::nullopt;
+			}
+			s.lru.splice(s.lru.begin(), s.lru, it->second);
+			s.hits++;
+			return it->second->value;
+		}
+
+		/** Insert or replace, then evict down to the limits. **/
+		void put(std::string_view key, V value) {
+			Shard& s = shardFor(key);
+			const size_t bytes = key.size() + cache_size_of(value);
+
+			std::lock_guard<std::mutex> lock(s.mu);
+			auto it = s.index.find(key);
+			if (it != s.index.end()) {
+				s.bytes -= it->second->bytes;
+				it->second->value = std::move(value);
+				it->second->bytes = bytes;
+				s.bytes += bytes;
+				s.lru.splice(s.lru.begin(), s.lru, it->second);
+			} else {
+				s.lru.push_front(Node{std::string(key), std::move(value), bytes});
+				// The index keys view the node's own string, which never moves
+				s.index.emplace(std::string_view(s.lru.front().key), s.lru.begin());
+				s.bytes += bytes;
+			}
+
+			while (s.lru.size() > 1 &&
+					(s.lru.size() > maxEntries_ || (maxBytes_ && s.bytes > maxBytes_))) {
+				Node& victim = s.lru.back();
+				s.index.erase(std::string_view(victim.key));
+				s.bytes -= victim.bytes;
+				s.lru.pop_back();
+				s.evictions++;
+			}
+		}
+
+		/** Remove an entry. Returns true if it was present. **/
+		bool erase(std::string_view key) {
+			Shard& s = shardFor(key);
+			std::lock_guard<std::mutex> lock(s.mu);
+			auto it = s.index.find(key);
+			if (it == s.index.end()) return false;
+			s.bytes -= it->second->bytes;
+			auto node = it->second;
+			s.index.erase(it);
+			s.lru.erase(node);
+			return true;
+		}
+
+		/** Counters summed over all shards. **/
+		Stats stats() const {
+			Stats total;
+			for (const Shard& s : shards_) {
+				std::lock_guard<std::mutex> lock(s.mu);
+				total.hits      += s.hits;
+				total.misses    += s.misses;
+				total.evictions += s.evictions;
+				total.entries   += s.lru.size();
+				total.bytes     += s.bytes;
+			}
+			return total;
+		}
+
+	private:
+		struct Node {
+			std::string key;
+			V           value;
+			size_t      bytes;
+		};
+
+		using List = std::list<Node>;
+
+		struct Shard {
+			mutable std::mutex mu;
+			List               lru; // front = most recently used
+			std::unordered_map<std::string_view, typename List::iterator> index;
+			size_t             bytes     = 0;
+			uint64_t           hits      = 0;
+			uint64_t           misses    = 0;
+			uint64_t           evictions = 0;
+		};
+
+		Shard& shardFor(std::string_view key) {
+			return shards_[std::hash<std::string_view>{}(key) % Shards];
+		}
+
+		const size_t               maxEntries_;
+		const size_t               maxBytes_;
+		std::array<Shard, Shards>  shards_;
+};
@@ -5,37 +5,81 @@
 #include <chrono>
 #include <cstdlib>
 #include <sstream>
+#include <algorithm>
+#include <memory>
 
 #include "config.hpp"
 #include "rpc.hpp"
 #include "mpd.hpp"
 #include "album_art.hpp"
+#include "art_resolver.hpp"
+#include "art_cache.hpp"
+#include "http_client.hpp"
+#include "prewarm.hpp"
+#include "alloc_stats.hpp"
+#include "event_loop.hpp"
 #include "logger.hpp"
 
 std::atomic<bool> keepRunning(true);
 
 std::vector<std::string> artMethods;
 
-void signalHandler(int signum) {
-	LOG_INFO("Received signal " << signum << ", stopping...");
+// Only used by --prewarm; the daemon takes signals through the event loop.
+// Async-signal-safe: no logging here.
+void signalHandler(int) {
 	keepRunning = false;
+	requestMPDShutdown();
 }
 
 Config g_config("MPD-Presence.conf");
 
+// Queue low-priority art lookups for the next songs in the MPD queue so the
+// cover is already cached when the track changes.
+static void prefetchUpcomingArt() {
+	const int count = g_config.getPrefetchCount();
+	if (count <= 0) return;
+
+	std::vector<ArtJob> jobs;
+	for (const auto& e : getMPDUpcoming(static_cast<unsigned>(count))) {
+		// Streams have no album to look up
+		if (classifyMPDUri(e.uri) == MPDSource::Stream) continue;
+
+		ArtJob job;
+		job.songID           = e.songID;
+		job.duration         = e.duration;
+		job.uri              = e.uri;
+		job.artist           = e.artist;
+		job.album            = e.album;
+		job.albumArtist      = e.albumArtist;
+		job.date             = e.date;
+		job.mbAlbumID        = e.mbAlbumID;
+		job.mbReleaseGroupID = e.mbReleaseGroupID;
+		jobs.push_back(std::move(job));
+	}
+
+	if (!jobs.empty()) {
+		LOG_DEBUG("Prefetching album art for " << jobs.size() << " upcoming song(s)");
+		art_resolver_prefetch(std::move(jobs));
+	}
+}
+
 int main(int argc, char* argv[]) {
 	std::signal(SIGINT,  signalHandler);
 	std::signal(SIGTERM, signalHandler);
 
 	bool verbose = false;
+	bool prewarm = false;
 	for (int i = 1; i < argc; ++i) {
 		std::string arg = argv[i];
 		if (arg == "--verbose" || arg == "-v")   verbose = true;
+		else if (arg == "--prewarm")             prewarm = true;
 		else if (arg == "--help" || arg == "-h") {
 			std::cout <<
 				"Usage: MPD-Presence [OPTIONS]\n\n"
 				"Options:\n"
 				"  -v, --verbose  Enable DEBUG-level logging\n"
+				"      --prewarm  Resolve album art for the whole MPD database\n"
+				"                 into the cache, then exit (resumable)\n"
 				"  -h, --help     Show this message\n\n";
 			return 0;
 		}
@@ -49,20 +93,35 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
-	// Album art method order
-	std::string methodsStr = g_config.getAlbumArtMethodOrder();
-	if (methodsStr.empty()) methodsStr = "fingerprint,search";
+	// Persistent album art cache -- lookups just miss if it cannot be opened
+	art_cache_open();
 
-	{
-		std::istringstream iss(methodsStr);
+	// Album art method order; the default also stands in for a value that
+	// names no method at all
+	constexpr const char* DEFAULT_ART_METHODS = "tags,fingerprint,search";
+	auto parseMethods = [](const std::string& list) {
+		std::istringstream iss(list);
 		std::string method;
 		while (std::getline(iss, method, ',')) {
 			method.erase(0, method.find_first_not_of(" \t"));
 			method.erase(method.find_last_not_of(" \t") + 1);
 			if (!method.empty()) artMethods.push_back(method);
 		}
+	};
+	parseMethods(g_config.getAlbumArtMethodOrder());
+	if (artMethods.empty()) parseMethods(DEFAULT_ART_METHODS);
+
+	if (prewarm) {
+		int rc = run_prewarm(keepRunning);
+		http_log_stats();
+		log_album_art_cache_stats();
+		return rc;
 	}
-	if (artMethods.empty()) artMethods = {"fingerprint", "search"};
+
+	// Signals are read from the event loop from here on. Every thread
+	// started below inherits the blocked mask.
+	if (!event_loop_take_signals())
+		LOG_WARN("Signals will not be handled through the event loop");
 
 	// Initial MPD fetch so we have a valid state before RPC init
 	fetchMPDInfo();
@@ -71,49 +130,72 @@ int main(int argc, char* argv[]) {
 	rpc_load_button_settings();
 	rpc_initialize();
 
+	art_resolver_start(artMethods);
+
 	int     lastSongID          = -1;
 	bool    lastPaused          = false;
 	int64_t lastElapsed         = 0;
+	int64_t lastTick            = 0;
 	bool    lastWasIdle         = true;
 
-	while (keepRunning) {
-		fetchMPDInfo();
+	// Internet radio changes title (ICY metadata) without changing the song
+	// ID, some stations several times a minute. Refresh the text at most
+	// this often; a newer title seen in between is pushed by a timer.
+	constexpr int64_t STREAM_METADATA_INTERVAL_S = 15;
+	std::string lastTitle, lastArtist;
+	int64_t     lastMetadataPush    = 0;
+	bool        metadataPending     = false;
+
+	// Ignored folders as full path prefixes, built once rather than per tick
+	std::vector<std::string> ignoredPrefixes;
+	for (const auto& p : g_config.getIgnoreList()) {
+		// Strip leading slash so "/AMSR" matches "music_folder/AMSR/..."
+		const std::string rel = (!p.empty() && p[0] == '/') ? p.substr(1) : p;
+		ignoredPrefixes.push_back(g_config.getMusicFolder() + rel);
+	}
+
+	unsigned events = MPD_EVENT_NONE;
 
-		const std::string title   = getMPDTitle();
-		const std::string album   = getMPDAlbum();
-		const std::string artist  = getMPDArtist();
-		const std::string date    = getMPDDate();
-		const int         songID  = getMPDSongID();
-		const bool        paused  = getMPDIsPaused();
-		const int64_t     elapsed = getMPDElapsed();
-		const int64_t     total   = getMPDTotal();
+	while (true) {
+		const uint64_t tickAllocations = alloc_stats_count();
 
-		const bool isIdle = !getMPDIsValid()
+		fetchMPDInfo();
+
+		// One snapshot per tick: fields are read in place, never copied
+		const std::shared_ptr<const MPDState> state = getMPDState();
+		const std::string& title   = state->title;
+		const std::string& album   = state->album;
+		const std::string& artist  = state->artist;
+		const std::string& date    = state->date;
+		const int          songID  = state->SongID;
+		const bool         paused  = state->paused;
+		const int64_t      elapsed = state->elapsed;
+		const int64_t      total   = state->total;
+		const bool         stream  = state->source == MPDSource::Stream;
+
+		const bool isIdle = !state->valid
 			|| title  == "Unknown Title"
 			|| artist == "Unknown Artist"
-			|| [&]() {
-				const std::string& fp = getMPDFilePath();
-				const std::string& mf = g_config.getMusicFolder();
-				for (const auto& p : g_config.getIgnoreList()) {
-					// Strip leading slash so "/AMSR" matches "music_folder/AMSR/..."
-					const std::string rel = (!p.empty() && p[0] == '/') ? p.substr(1) : p;
-					if (fp.find(mf + rel) == 0) return true;
-				}
-				return false;
-			}();
+			|| std::any_of(ignoredPrefixes.begin(), ignoredPrefixes.end(),
+					[&](const std::string& prefix) {
+						return state->filePath.compare(0, prefix.size(), prefix) == 0;
+					});
 
 		const bool trackChanged      = (songID != lastSongID);
 		const bool pauseStateChanged = (paused != lastPaused);
 		const bool idleStateChanged  = (isIdle != lastWasIdle);
 
-		const bool seekDetected = !isIdle && !paused && !trackChanged &&
-			std::abs(elapsed - lastElapsed) > 3;
-
 		int64_t now = static_cast<int64_t>(std::time(nullptr));
 
+		// Wake-ups are event driven, so compare against where playback should
+		// be by now rather than against the previous sample.
+		const bool seekDetected = !isIdle && !paused && !trackChanged &&
+			std::abs(elapsed - (lastElapsed + (now - lastTick))) > 3;
+
 		bool needsUpdate = false;
 
 		if (isIdle) {
+			metadataPending = false; // nothing to push a title for
 			if (idleStateChanged) {
 				LOG_INFO("Entering idle state — clearing Discord presence");
 				rpc_clear_presence();
@@ -126,7 +208,6 @@ int main(int argc, char* argv[]) {
 			if (trackChanged || idleStateChanged) {
 				LOG_INFO("Track changed: " << title << " — " << artist);
 
-				const std::string fingerprint = getMPDFingerprint();
 				const int         trackTotal  = static_cast<int>(total);
 
 				int64_t startTime = 0, endTime = 0;
@@ -135,43 +216,10 @@ int main(int argc, char* argv[]) {
 					endTime   = now + (total - elapsed);
 				}
 
-				// Fetch album art synchronously before pushing presence
-				AlbumUrls urls;
-				for (const auto& method : artMethods) {
-					if (method == "fingerprint") {
-						if (!fingerprint.empty()) {
-							urls = get_album_urls_fingerprint(
-									trackTotal, fingerprint, "2jFwlOUpO2");
-							if (!urls.cover_url.empty()) {
-								LOG_INFO("Album art: fingerprint succeeded");
-								break;
-							}
-						}
-					} else if (method == "search") {
-						if (!artist.empty() && artist != "Unknown Artist" &&
-								!album.empty()  && album  != "Unknown Album"  &&
-								!date.empty()   && date   != "Unknown Date") {
-							urls = get_album_urls_search(artist, album, date, 100);
-							if (!urls.cover_url.empty()) {
-								LOG_INFO("Album art: search succeeded");
-								break;
-							}
-						}
-					}
-				}
-
-				// When playing, show "View Album" only if config Button1 is set and art was found
-				std::string btnLabel, btnUrl;
-				{
-					std::string cfgLabel = g_config.getButton1Label();
-					std::string cfgUrl   = g_config.getButton1Url();
-					if (!cfgLabel.empty() && !cfgUrl.empty() && !urls.page_url.empty()) {
-						btnLabel = "View Album";
-						btnUrl   = urls.page_url;
-					}
-				}
-
-				// Set all metadata + art in one go, then push once
+				// Push the text presence right away, with the cover if it is
+				// already cached (e.g. prefetched). Otherwise album art is
+				// resolved in the background and applied if this song is
+				// still current.
 				rpc_set_current_song(songID,
 						title,
 						date.empty() ? artist : artist + " - " + date,
@@ -179,22 +227,46 @@ int main(int argc, char* argv[]) {
 						startTime,
 						endTime);
 
-				rpc_set_largeimage(urls.cover_url.empty() ? "mpd" : urls.cover_url);
-
-				if (!btnLabel.empty() && !btnUrl.empty())
-					rpc_set_button1(btnLabel, btnUrl);
+				// A stream has no album to look up: keep the placeholder
+				ArtJob job;
+				bool   haveArt = false;
+				if (!stream) {
+					job.songID           = songID;
+					job.duration         = trackTotal;
+					job.uri              = state->uri;
+					job.artist           = artist;
+					job.album            = album;
+					job.albumArtist      = state->albumArtist;
+					job.date             = date;
+					job.mbAlbumID        = state->mbAlbumID;
+					job.mbReleaseGroupID = state->mbReleaseGroupID;
+
+					ArtResult cached;
+					if (art_resolver_cached(job, cached)) {
+						LOG_INFO("Album art: cache hit");
+						rpc_set_largeimage(cached.cover_url);
+						if (!cached.btnLabel.empty())
+							rpc_set_button1(cached.btnLabel, cached.btnUrl);
+						haveArt = true;
+					}
+				}
 
 				rpc_update_presence();
 
+				if (!stream && !haveArt) art_resolver_submit(std::move(job));
+
+				prefetchUpcomingArt();
+
 				lastSongID          = songID;
 				lastWasIdle         = false;
 				lastPaused          = paused;
-				lastElapsed         = elapsed;
-				continue;
+				lastTitle           = title;
+				lastArtist          = artist;
+				lastMetadataPush    = now;
+				metadataPending     = false;
 			}
-
 			// Pause/resume or seek
-			if (pauseStateChanged || seekDetected) {
+			else if (pauseStateChanged || seekDetected) {
 				if (paused || total == 0) {
 					rpc_set_starttime(0);
 					rpc_set_endtime(0);
@@ -206,8 +278,43 @@ int main(int argc, char* argv[]) {
 				lastPaused           = paused;
 				lastElapsed          = elapsed;
 			}
+
+			// New song on the same stream. A title that changed back, or
+			// leaving the stream, cancels a push still waiting for the interval.
+			const bool streamTitleChanged = !trackChanged && !idleStateChanged && stream &&
+				(title != lastTitle || artist != lastArtist);
+			if (!streamTitleChanged) {
+				metadataPending = false;
+			} else {
+				metadataPending = now - lastMetadataPush < STREAM_METADATA_INTERVAL_S;
+				if (!metadataPending) {
+					LOG_INFO("Stream title changed: " << title << " — " << artist);
+					rpc_set_current_song(songID,
+							title,
+							artist,
+							album,
+							0,
+							0);
+					needsUpdate      = true;
+					lastTitle        = title;
+					lastArtist       = artist;
+					lastMetadataPush = now;
+				}
+			}
+
+			// Queue edited or shuffled: the upcoming songs may be different
+			if (!trackChanged && !idleStateChanged &&
+					(events & (MPD_EVENT_PLAYLIST | MPD_EVENT_OPTIONS)))
+				prefetchUpcomingArt();
 		}
 
+		// Covers the resolver finished since the last pass. Results for a
+		// song that is no longer playing are dropped by the song ID check.
+		ArtResult art;
+		while (art_resolver_take_result(art))
+			rpc_apply_art_if_current(art.songID, art.cover_url, art.page_url,
+					art.btnLabel, art.btnUrl);
+
 		if (needsUpdate) {
 			LOG_DEBUG("Updating Discord presence");
 			rpc_update_presence();
@@ -220,9 +327,42 @@ int main(int argc, char* argv[]) {
 		}
 
 		lastElapsed = elapsed;
-		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		lastTick    = now;
+
+		if (alloc_stats_enabled())
+			LOG_INFO("Tick allocations: " << alloc_stats_count() - tickAllocations
+					<< " (MPD state v" << state->version << ")");
+
+		// Sleep until MPD changes, a signal arrives, the art resolver hands
+		// over a cover, or the timer says a deferred push
+		// (Discord's rate limit, a throttled stream title) is due.
+		// Anything already due was handled by this pass, so a deadline that
+		// still reads as due is never armed as a zero timer (which would
+		// fire straight away, every pass); it is retried a second later.
+		int timerMs = rpc_pending_flush_delay_ms();
+		if (metadataPending) {
+			const int ms = static_cast<int>(std::max<int64_t>(0,
+						lastMetadataPush + STREAM_METADATA_INTERVAL_S - now) * 1000);
+			timerMs = timerMs < 0 ? ms : std::min(timerMs, ms);
+		}
+		if (timerMs == 0) timerMs = 1000;
+		event_loop_set_timer(timerMs);
+
+		events = waitMPDEvent(-1);
+		if (events & MPD_EVENT_SHUTDOWN) {
+			if (const int sig = event_loop_last_signal())
+				LOG_INFO("Received signal " << sig << ", stopping...");
+			break;
+		}
 	}
 
+	// Abandon a fingerprint MPD may still be decoding
+	requestMPDShutdown();
+
+	art_resolver_stop();
+	art_resolver_log_stats();
+	http_log_stats();
+	log_album_art_cache_stats();
 	rpc_shutdown();
 	LOG_INFO("Discord RPC shutdown complete");
 	return 0;
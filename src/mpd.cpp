@@ -1,90 +1,603 @@
 #include <string>
 #include <vector>
-#include <thread>
-#include <csignal>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstddef>
+#include <cctype>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <chrono>
+#include <random>
+#include <cerrno>
+#include <functional>
+
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <mpd/client.h>
 
 #include "mpd.hpp"
+#include "event_loop.hpp"
 #include "config.hpp"
 #include "logger.hpp"
+#include "lru_cache.hpp"
 
+// Working copy filled in by fetchMPDInfo() on the main thread. Fields are
+// assigned in place, so polls that change nothing reuse their buffers.
 static MPDState g_mpd;
 
+// What everyone else reads: an immutable snapshot of g_mpd, replaced (never
+// modified) whenever a poll sees a change. Readers hold on to the
+// shared_ptr for as long as they need a consistent view.
+static std::atomic<std::shared_ptr<const MPDState>> g_snapshot{
+	std::make_shared<const MPDState>()};
+
 // Persistent connection — reconnect only on failure
 static mpd_connection* g_conn = nullptr;
 
+using Clock = std::chrono::steady_clock;
+
+// Reconnecting g_conn never blocks the main loop: the socket is
+// non-blocking, each call to ensureConnected() advances the attempt, and
+// waitMPDEvent() sleeps on the socket (or until the next attempt is due).
+// Failed attempts back off exponentially, with jitter, up to a cap.
+enum class ConnectPhase {
+	Idle,       // no attempt in flight; next one at g_nextAttempt
+	Connecting, // waiting for connect() to complete
+	Welcome,    // connected, waiting for MPD's "OK MPD x.y.z" line
+	Password,   // sending "password" and waiting for its reply
+};
+static ConnectPhase      g_phase = ConnectPhase::Idle;
+static int               g_connectFd = -1;
+static std::string       g_welcome;
+static std::string       g_authOut;   // unsent part of the password command
+static std::string       g_authReply; // reply to it, up to its newline
+static Clock::time_point g_nextAttempt;
+static Clock::time_point g_attemptDeadline;
+static unsigned          g_failedAttempts = 0;
+static unsigned          g_addressIndex   = 0;
+static Clock::time_point g_downSince;
+
+static constexpr int RECONNECT_MIN_MS   = 250;
+static constexpr int RECONNECT_MAX_MS   = 5000;
+static constexpr int CONNECT_TIMEOUT_MS = 5000;  // connect + welcome + password
+static constexpr int COMMAND_TIMEOUT_MS = 30000; // replies on g_conn
+
+// Second connection for commands that keep MPD busy for seconds (decoding a
+// file for a fingerprint), so they never hold up status/idle on g_conn.
+// Used from the art resolver thread, hence the mutex.
+static std::mutex      g_heavyMutex;
+static mpd_connection* g_heavyConn = nullptr;
+
+// How often a running fingerprint checks whether it is still wanted
+static constexpr int CANCEL_CHECK_MS = 100;
+
+// Written by requestMPDShutdown() to abort a running fingerprint; waits on
+// the main thread go through the event loop and check the flag instead
+static int g_shutdownFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+static std::atomic<bool> g_shutdownRequested{false};
+
+// Cleared the first time the server rejects `idle`; we then poll instead
+static bool g_idleSupported = true;
+
+// Interval used by the polling fallback (the pre-idle behaviour)
+static constexpr int POLL_INTERVAL_MS = 250;
+
+// Chromaprint fingerprints memoised by song URI (least recently used
+// evicted first), so replays and repeated tracks never make MPD decode the
+// file again. Only the art resolver computes them, hence a single shard.
+static ShardedLruCache<std::string, 1> g_fingerprintCache(64, 4 << 20);
+
+static constexpr mpd_idle IDLE_MASK = static_cast<mpd_idle>(
+		MPD_IDLE_PLAYER | MPD_IDLE_PLAYLIST | MPD_IDLE_OPTIONS);
+
+// Where and as whom to connect
+struct Endpoint {
+	std::string host;     // name, address, or socket path ('/' or '@...')
+	unsigned    port = 0; // 0 for a socket path
+	std::string password;
+};
+
+// The endpoint of the attempt in flight (or of the live g_conn)
+static Endpoint g_endpoint;
+
+static bool isSocketPath(const std::string& host) {
+	return !host.empty() && (host[0] == '/' || host[0] == '@');
+}
+
+// Resolve the endpoint the way libmpdclient does for mpd_connection_new():
+// the config first, then MPD_HOST ("password@host" allowed) and MPD_PORT,
+// then localhost:6600. Both connections use this so they always agree.
+static Endpoint resolveEndpoint() {
+	Endpoint ep;
+	ep.host     = g_config.getHost();
+	ep.password = g_config.getPassword();
+	if (g_config.getPort() > 0) ep.port = static_cast<unsigned>(g_config.getPort());
+
+	if (ep.host.empty()) {
+		if (const char* env = getenv("MPD_HOST"); env && *env) {
+			ep.host = env;
+			// A leading '@' is an abstract socket, not an empty password
+			const size_t at = ep.host.find('@');
+			if (at != std::string::npos && at > 0) {
+				if (ep.password.empty()) ep.password = ep.host.substr(0, at);
+				ep.host.erase(0, at + 1);
+			}
+		}
+		if (ep.host.empty()) ep.host = "localhost";
+	}
+
+	if (isSocketPath(ep.host)) {
+		ep.port = 0;
+	} else if (ep.port == 0) {
+		if (const char* env = getenv("MPD_PORT"); env && *env)
+			ep.port = static_cast<unsigned>(strtoul(env, nullptr, 10));
+		if (ep.port == 0) ep.port = 6600;
+	}
+	return ep;
+}
+
+// "host:port", or just the path for a local socket
+static std::string describe(const Endpoint& ep) {
+	return ep.port ? ep.host + ":" + std::to_string(ep.port) : ep.host;
+}
+
+// Open and authenticate a connection, blocking. Only for the heavy
+// connection, which lives on the art resolver thread. Null on failure;
+// `authFailed` tells a rejected password apart from an unreachable server.
+static mpd_connection* openConnection(bool& authFailed) {
+	authFailed = false;
+	const Endpoint ep = resolveEndpoint();
+	mpd_connection* conn = mpd_connection_new(
+			ep.host.c_str(),
+			ep.port,
+			COMMAND_TIMEOUT_MS
+			);
+
+	if (!conn || mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
+		if (conn) mpd_connection_free(conn);
+		return nullptr;
+	}
+
+	if (!ep.password.empty()) {
+		if (!mpd_run_password(conn, ep.password.c_str())) {
+			authFailed = true;
+			mpd_connection_free(conn);
+			return nullptr;
+		}
+	}
+	return conn;
+}
+
+// Close a half-open attempt and schedule the next one
+static void connectFailed(const std::string& why) {
+	if (g_connectFd >= 0) close(g_connectFd);
+	g_connectFd = -1;
+	g_phase     = ConnectPhase::Idle;
+	g_welcome.clear();
+	g_authOut.clear();
+	g_authReply.clear();
+	g_addressIndex++;
+
+	// 250 ms, 500 ms, 1 s, ... capped; the actual delay is drawn from the
+	// upper half so clients restarted together do not retry in lockstep
+	static std::minstd_rand rng{std::random_device{}()};
+	const int shift = static_cast<int>(std::min(g_failedAttempts, 5u));
+	const int delay = std::min(RECONNECT_MAX_MS, RECONNECT_MIN_MS << shift);
+	const int jittered = delay / 2 + static_cast<int>(rng() % static_cast<unsigned>(delay / 2 + 1));
+	g_nextAttempt = Clock::now() + std::chrono::milliseconds(jittered);
+
+	// Log the outage once; retries are only interesting when debugging
+	if (g_failedAttempts++ == 0)
+		LOG_ERR("MPD connection failed: " << why << " -- retrying in the background");
+	else
+		LOG_DEBUG("MPD connection attempt " << g_failedAttempts << " failed: " << why
+				<< " (next in " << jittered << " ms)");
+}
+
+// Start a non-blocking connect to the resolved endpoint. A host starting
+// with '/' (or '@' for the abstract namespace) is a local socket path.
+static void beginConnect() {
+	g_endpoint = resolveEndpoint();
+	const std::string& host = g_endpoint.host;
+	sockaddr_storage addr{};
+	socklen_t addrLen = 0;
+
+	if (isSocketPath(host)) {
+		sockaddr_un un{};
+		if (host.size() >= sizeof(un.sun_path)) {
+			connectFailed("socket path too long");
+			return;
+		}
+		un.sun_family = AF_UNIX;
+		memcpy(un.sun_path, host.data(), host.size());
+		if (host[0] == '@') un.sun_path[0] = '\0';
+		addrLen = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + host.size() +
+				(host[0] == '@' ? 0 : 1));
+		memcpy(&addr, &un, sizeof(un));
+	} else {
+		// Blocks only for names that need a DNS round trip; MPD is
+		// normally addressed by IP or a name from /etc/hosts
+		addrinfo hints{};
+		hints.ai_family   = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_flags    = AI_NUMERICSERV;
+		addrinfo* res = nullptr;
+		const std::string port = std::to_string(g_endpoint.port);
+		const int rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+		if (rc != 0 || !res) {
+			connectFailed(std::string("cannot resolve ") + host + ": " + gai_strerror(rc));
+			return;
+		}
+
+		// Rotate through the addresses, one per attempt
+		unsigned count = 0;
+		for (addrinfo* ai = res; ai; ai = ai->ai_next) count++;
+		addrinfo* ai = res;
+		for (unsigned i = g_addressIndex % count; i > 0; --i) ai = ai->ai_next;
+		memcpy(&addr, ai->ai_addr, ai->ai_addrlen);
+		addrLen = ai->ai_addrlen;
+		freeaddrinfo(res);
+	}
+
+	g_connectFd = socket(addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (g_connectFd < 0) {
+		connectFailed(std::string("socket(): ") + strerror(errno));
+		return;
+	}
+
+	g_attemptDeadline = Clock::now() + std::chrono::milliseconds(CONNECT_TIMEOUT_MS);
+	if (connect(g_connectFd, reinterpret_cast<sockaddr*>(&addr), addrLen) == 0) {
+		g_phase = ConnectPhase::Welcome;
+	} else if (errno == EINPROGRESS) {
+		g_phase = ConnectPhase::Connecting;
+	} else {
+		connectFailed(strerror(errno));
+	}
+}
+
+// Hand the socket to libmpdclient once the welcome line is in
+static void finishConnect() {
+	mpd_async* async = mpd_async_new(g_connectFd);
+	if (!async) {
+		connectFailed("out of memory");
+		return;
+	}
+	g_connectFd = -1; // owned by `async` from here on
+
+	mpd_connection* conn = mpd_connection_new_async(async, g_welcome.c_str());
+	g_welcome.clear();
+	g_authReply.clear();
+	g_phase = ConnectPhase::Idle;
+	if (!conn) {
+		mpd_async_free(async);
+		connectFailed("out of memory");
+		return;
+	}
+	if (mpd_connection_get_error(conn) != MPD_ERROR_SUCCESS) {
+		const std::string why = mpd_connection_get_error_message(conn);
+		mpd_connection_free(conn);
+		connectFailed(why);
+		return;
+	}
+	mpd_connection_set_timeout(conn, COMMAND_TIMEOUT_MS);
+
+	g_conn = conn;
+	if (g_failedAttempts > 0) {
+		LOG_INFO("MPD reconnected to " << describe(g_endpoint)
+				<< " after " << std::chrono::duration_cast<std::chrono::seconds>(
+					Clock::now() - g_downSince).count() << " s");
+	} else {
+		LOG_INFO("MPD connected to " << describe(g_endpoint));
+	}
+	g_failedAttempts = 0;
+}
+
+// Read from the connecting socket until `buf` holds a full line, which is
+// returned without its newline. Empty while more is to come; false once
+// the attempt has failed.
+static bool readConnectLine(std::string& buf, std::string& line) {
+	char chunk[128];
+	while (true) {
+		const ssize_t n = recv(g_connectFd, chunk, sizeof(chunk), 0);
+		if (n > 0) {
+			buf.append(chunk, static_cast<size_t>(n));
+			const size_t eol = buf.find('\n');
+			if (eol != std::string::npos) {
+				line = buf.substr(0, eol);
+				return true;
+			}
+			if (buf.size() > 256) {
+				connectFailed("malformed reply");
+				return false;
+			}
+		} else if (n == 0) {
+			connectFailed("connection closed by server");
+			return false;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return true;
+		} else if (errno != EINTR) {
+			connectFailed(strerror(errno));
+			return false;
+		}
+	}
+}
+
+// Authenticate before handing the socket to libmpdclient, with the same
+// non-blocking I/O as the welcome line: mpd_run_password() would wait for
+// a stalled server for the full command timeout.
+static void advancePassword() {
+	while (!g_authOut.empty()) {
+		const ssize_t n = send(g_connectFd, g_authOut.data(), g_authOut.size(), MSG_NOSIGNAL);
+		if (n > 0) {
+			g_authOut.erase(0, static_cast<size_t>(n));
+		} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return;
+		} else if (n < 0 && errno != EINTR) {
+			connectFailed(strerror(errno));
+			return;
+		}
+	}
+
+	std::string reply;
+	if (!readConnectLine(g_authReply, reply) || reply.empty()) return;
+	if (reply == "OK")
+		finishConnect();
+	else
+		connectFailed("authentication failed: " + reply);
+}
+
+// Queue the password command, quoted the way MPD parses arguments
+static void beginPassword() {
+	g_authOut = "password \"";
+	for (char c : g_endpoint.password) {
+		if (c == '"' || c == '\\') g_authOut += '\\';
+		g_authOut += c;
+	}
+	g_authOut += "\"\n";
+	g_phase = ConnectPhase::Password;
+}
+
+// Advance an attempt in flight as far as it goes without blocking
+static void advanceConnect() {
+	if (Clock::now() >= g_attemptDeadline) {
+		connectFailed("timed out");
+		return;
+	}
+
+	if (g_phase == ConnectPhase::Connecting) {
+		pollfd pfd{g_connectFd, POLLOUT, 0};
+		if (poll(&pfd, 1, 0) <= 0) return;
+
+		int err = 0;
+		socklen_t len = sizeof(err);
+		getsockopt(g_connectFd, SOL_SOCKET, SO_ERROR, &err, &len);
+		if (err != 0) {
+			connectFailed(strerror(err));
+			return;
+		}
+		g_phase = ConnectPhase::Welcome;
+	}
+
+	// Read the welcome line; MPD sends nothing else until we speak
+	if (g_phase == ConnectPhase::Welcome) {
+		std::string line;
+		if (!readConnectLine(g_welcome, line) || line.empty()) return;
+		g_welcome = std::move(line);
+		if (g_endpoint.password.empty()) {
+			finishConnect();
+			return;
+		}
+		beginPassword();
+	}
+
+	advancePassword();
+}
+
+// True when g_conn is usable. Never blocks: while MPD is unreachable this
+// starts or advances a reconnect attempt and returns false.
 static bool ensureConnected() {
 	// If we have a live connection, reuse it
 	if (g_conn && mpd_connection_get_error(g_conn) == MPD_ERROR_SUCCESS) {
 		return true;
 	}
 
-	// Clean up broken connection
+	// Clean up broken connection; the first reconnect attempt is immediate
 	if (g_conn) {
 		mpd_connection_free(g_conn);
 		g_conn = nullptr;
 	}
 
-	static int retryCount = 0;
-	const int maxRetries = 20;
+	if (g_phase == ConnectPhase::Idle) {
+		if (Clock::now() < g_nextAttempt) return false;
+		if (g_failedAttempts == 0) g_downSince = Clock::now();
+		beginConnect();
+	}
+	if (g_phase != ConnectPhase::Idle) advanceConnect();
 
-	g_conn = mpd_connection_new(
-			g_config.getHost().c_str(),
-			g_config.getPort(),
-			30000
-			);
+	return g_conn != nullptr;
+}
 
-	if (!g_conn || mpd_connection_get_error(g_conn) != MPD_ERROR_SUCCESS) {
-		LOG_ERR("MPD connection failed (" << retryCount << "/" << maxRetries << ")");
-		if (g_conn) {
-			mpd_connection_free(g_conn);
-			g_conn = nullptr;
-		}
-		std::this_thread::sleep_for(std::chrono::seconds(2));
+// MPD event mask for an event loop wake-up that did not come from MPD
+static unsigned loopEvents(unsigned ready) {
+	if ((ready & LOOP_SIGNAL) || g_shutdownRequested) return MPD_EVENT_SHUTDOWN;
+	return MPD_EVENT_TIMEOUT;
+}
 
-		retryCount++;
-		if (retryCount >= maxRetries) {
-			LOG_ERR("Max retries reached. Sending quit signal.");
-			std::raise(SIGTERM);
-		}
-		return false;
+// Wait (up to timeoutMs, -1 = forever) for the reconnect attempt to make
+// progress or the next one to be due, waking early for loop events.
+static unsigned waitReconnect(int timeoutMs) {
+	if (g_shutdownRequested) return MPD_EVENT_SHUTDOWN;
+
+	const Clock::time_point until =
+		g_phase == ConnectPhase::Idle ? g_nextAttempt : g_attemptDeadline;
+	const auto due = std::chrono::duration_cast<std::chrono::milliseconds>(
+			until - Clock::now()).count();
+	int waitMs = static_cast<int>(std::clamp<int64_t>(due, 0, RECONNECT_MAX_MS));
+	if (timeoutMs >= 0) waitMs = std::min(waitMs, timeoutMs);
+
+	const int fd = g_phase == ConnectPhase::Idle ? -1 : g_connectFd;
+	const bool sending = g_phase == ConnectPhase::Connecting ||
+		(g_phase == ConnectPhase::Password && !g_authOut.empty());
+	const uint32_t want = sending ? EPOLLOUT : EPOLLIN;
+	return loopEvents(event_loop_wait(fd, want, waitMs));
+}
+
+// Block until connected, for callers that cannot do anything without MPD
+// (--prewarm). Gives up after timeoutMs or on shutdown.
+static bool waitConnected(int timeoutMs) {
+	const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeoutMs);
+	while (!ensureConnected()) {
+		const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - Clock::now()).count();
+		if (left <= 0) return false;
+		if (waitReconnect(static_cast<int>(left)) & MPD_EVENT_SHUTDOWN) return false;
 	}
+	return true;
+}
 
-	retryCount = 0;
+// Same for the heavy-command connection. Never sleeps or retries: a failed
+// fingerprint is simply skipped. Call with g_heavyMutex held.
+static bool ensureHeavyConnected() {
+	if (g_heavyConn && mpd_connection_get_error(g_heavyConn) == MPD_ERROR_SUCCESS)
+		return true;
 
-	if (!g_config.getPassword().empty()) {
-		if (!mpd_run_password(g_conn, g_config.getPassword().c_str())) {
-			LOG_ERR("MPD authentication failed");
-			mpd_connection_free(g_conn);
-			g_conn = nullptr;
-			return false;
-		}
+	if (g_heavyConn) {
+		mpd_connection_free(g_heavyConn);
+		g_heavyConn = nullptr;
 	}
 
-	LOG_INFO("MPD connected to " << g_config.getHost() << ":" << g_config.getPort());
+	bool authFailed = false;
+	g_heavyConn = openConnection(authFailed);
+	if (!g_heavyConn) {
+		LOG_ERR("MPD fingerprint connection failed" << (authFailed ? " (authentication)" : ""));
+		return false;
+	}
+	LOG_DEBUG("MPD fingerprint connection opened");
 	return true;
 }
 
-void fetchMPDInfo() {
+static void dropHeavyConnection() {
+	if (g_heavyConn) {
+		mpd_connection_free(g_heavyConn);
+		g_heavyConn = nullptr;
+	}
+}
+
+static void dropConnection() {
+	if (g_conn) {
+		mpd_connection_free(g_conn);
+		g_conn = nullptr;
+	}
+}
+
+MPDSource classifyMPDUri(const std::string& uri) {
+	// Database songs are plain paths relative to the music directory
+	const size_t end = uri.find("://");
+	if (end == std::string::npos || end == 0) return MPDSource::File;
+
+	std::string scheme = uri.substr(0, end);
+	for (char& c : scheme) {
+		if (!std::isalnum(static_cast<unsigned char>(c)) && c != '+' && c != '-' && c != '.')
+			return MPDSource::File; // "://" inside a file name
+		c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+	}
+	if (scheme == "file") return MPDSource::File;
+
+	// Schemes of MPD's network stream input plugins (curl, ffmpeg, mms)
+	static const char* const STREAM_SCHEMES[] = {
+		"http", "https", "mms", "mmsh", "mmst", "mmsu",
+		"rtp", "rtsp", "rtmp", "rtmps", "rtmpt", "hls+http", "hls+https",
+	};
+	for (const char* s : STREAM_SCHEMES)
+		if (scheme == s) return MPDSource::Stream;
+
+	return MPDSource::Other;
+}
+
+// Host part of a stream URI, for stations that send no name
+static std::string uriHost(const std::string& uri) {
+	const size_t start = uri.find("://");
+	if (start == std::string::npos) return uri;
+	const size_t end = uri.find_first_of("/?#", start + 3);
+	return uri.substr(start + 3, end == std::string::npos ? std::string::npos : end - start - 3);
+}
+
+// Internet radio: MPD reports the station in `Name` and the ICY StreamTitle
+// ("Artist - Title" by convention) in `Title`. Split it so the presence reads
+// like a song, with the station in place of the album. The tags of a stream
+// never describe an album, so nothing is left for the art lookup to use.
+static void applyStreamTags(MPDState& s, const mpd_song* song) {
+	const std::string station = s.name.empty() ? uriHost(s.uri) : s.name;
+
+	const char* v = mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
+	const std::string streamTitle = v ? v : "";
+	const size_t sep = streamTitle.find(" - ");
+
+	if (mpd_song_get_tag(song, MPD_TAG_ARTIST, 0)) {
+		// Tagged properly (e.g. HLS with ID3): keep artist/title as they are
+	} else if (sep != std::string::npos && sep > 0 && sep + 3 < streamTitle.size()) {
+		s.artist = streamTitle.substr(0, sep);
+		s.title  = streamTitle.substr(sep + 3);
+	} else {
+		s.artist = station;
+		s.title  = streamTitle.empty() ? station : streamTitle;
+	}
+
+	s.album       = station;
+	s.albumArtist = s.artist;
+	s.date.clear();
+	s.mbAlbumID.clear();
+	s.mbReleaseGroupID.clear();
+}
+
+static void pollMPDState() {
+	// ensureConnected() reports the outage itself
 	if (!ensureConnected()) {
-		LOG_ERR("Failed to connect to MPD.");
 		g_mpd = {};
 		return;
 	}
 
-	mpd_status* status = mpd_run_status(g_conn);
-	if (!status) {
+	// status and currentsong in one command list: a single round trip,
+	// which is most of the cost of a poll over a slow link
+	const auto sent = std::chrono::steady_clock::now();
+	if (!mpd_command_list_begin(g_conn, true) ||
+			!mpd_send_status(g_conn) ||
+			!mpd_send_current_song(g_conn) ||
+			!mpd_command_list_end(g_conn)) {
+		LOG_ERR("Failed to send MPD status request -- dropping connection");
+		dropConnection();
+		g_mpd = {};
+		return;
+	}
+
+	mpd_status* status = mpd_recv_status(g_conn);
+	mpd_song*   song   = nullptr;
+	// No current song (stopped, empty queue) is an empty response, not an error
+	if (status && mpd_response_next(g_conn)) song = mpd_recv_song(g_conn);
+	if (!status || !mpd_response_finish(g_conn)) {
 		LOG_ERR("Failed to get MPD status -- dropping connection");
-		mpd_connection_free(g_conn);
-		g_conn = nullptr;
+		if (song)   mpd_song_free(song);
+		if (status) mpd_status_free(status);
+		dropConnection();
 		g_mpd = {};
 		return;
 	}
 
+	LOG_DEBUG("MPD status round trip: " << std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now() - sent).count() << " us");
+
 	mpd_state state = mpd_status_get_state(status);
 	if (state == MPD_STATE_PLAY || state == MPD_STATE_PAUSE) {
-		mpd_song* song = mpd_run_current_song(g_conn);
 		if (song) {
 			g_mpd.valid  = true;
 			g_mpd.paused = (state == MPD_STATE_PAUSE);
@@ -100,41 +613,39 @@ void fetchMPDInfo() {
 			v = mpd_song_get_tag(song, MPD_TAG_ALBUM, 0);
 			g_mpd.album = v ? v : "Unknown Album";
 
+			// (no ?: here -- mixing char* and std::string makes a temporary)
+			v = mpd_song_get_tag(song, MPD_TAG_ALBUM_ARTIST, 0);
+			if (v) g_mpd.albumArtist = v;
+			else   g_mpd.albumArtist = g_mpd.artist;
+
 			v = mpd_song_get_tag(song, MPD_TAG_DATE, 0);
 			g_mpd.date = v ? v : "";
 
-			v = mpd_song_get_uri(song);
-			if (v)
-				g_mpd.filePath = g_config.getMusicFolder() + v;
+			v = mpd_song_get_tag(song, MPD_TAG_MUSICBRAINZ_ALBUMID, 0);
+			g_mpd.mbAlbumID = v ? v : "";
 
-			g_mpd.SongID   = mpd_status_get_song_id(status);
-			g_mpd.elapsed  = mpd_status_get_elapsed_time(status);
-			g_mpd.total    = mpd_status_get_total_time(status);
+			v = mpd_song_get_tag(song, MPD_TAG_MUSICBRAINZ_RELEASEGROUPID, 0);
+			g_mpd.mbReleaseGroupID = v ? v : "";
 
-			const char* uri = mpd_song_get_uri(song);
-			if (uri) {
-				size_t bufsize = 8192;
-				std::vector<char> buffer(bufsize);
-
-				while (true) {
-					const char* fp = mpd_run_getfingerprint_chromaprint(g_conn, uri, buffer.data(), buffer.size());
-					if (fp) {
-						g_mpd.fingerprint = fp;
-						break;
-					} else if (errno == ERANGE) {
-						bufsize *= 2;
-						buffer.resize(bufsize);
-					} else {
-						g_mpd.fingerprint.clear();
-						LOG_ERR("Error getting fingerprint");
-						break;
-					}
-				}
+			v = mpd_song_get_uri(song);
+			g_mpd.uri      = v ? v : "";
+			g_mpd.source   = classifyMPDUri(g_mpd.uri);
+			if (v && g_mpd.source == MPDSource::File) {
+				static const std::string musicFolder = g_config.getMusicFolder();
+				g_mpd.filePath.assign(musicFolder).append(v);
 			} else {
-				g_mpd.fingerprint.clear();
+				g_mpd.filePath.clear();
 			}
 
-			mpd_song_free(song);
+			v = mpd_song_get_tag(song, MPD_TAG_NAME, 0);
+			g_mpd.name = v ? v : "";
+
+			if (g_mpd.source == MPDSource::Stream) applyStreamTags(g_mpd, song);
+
+			g_mpd.SongID      = mpd_status_get_song_id(status);
+			g_mpd.nextSongPos = mpd_status_get_next_song_pos(status);
+			g_mpd.elapsed  = mpd_status_get_elapsed_time(status);
+			g_mpd.total    = mpd_status_get_total_time(status);
 		}
 	} else {
 		// Stopped / unknown -- treat as idle
@@ -147,18 +658,285 @@ void fetchMPDInfo() {
 		g_mpd.album  = "";
 	}
 
+	if (song) mpd_song_free(song);
 	mpd_status_free(status);
 	// NOTE: do NOT free g_conn here -- it is persistent
 }
 
-bool        getMPDIsPaused()    { return g_mpd.paused; }
-std::string getMPDTitle()       { return g_mpd.title; }
-std::string getMPDArtist()      { return g_mpd.artist; }
-std::string getMPDAlbum()       { return g_mpd.album; }
-std::string getMPDDate()        { return g_mpd.date; }
-std::string getMPDFilePath()    { return g_mpd.filePath; }
-int         getMPDSongID()      { return g_mpd.SongID; }
-int64_t     getMPDElapsed()     { return g_mpd.elapsed; }
-int64_t     getMPDTotal()       { return g_mpd.total; }
-std::string getMPDFingerprint() { return g_mpd.fingerprint; }
-bool        getMPDIsValid()     { return g_mpd.valid; }
+// Publish g_mpd as a new snapshot if it differs from the current one.
+// Polls that change nothing (the common case) allocate nothing.
+static void publishMPDState() {
+	const std::shared_ptr<const MPDState> current = g_snapshot.load(std::memory_order_acquire);
+	g_mpd.version = current->version;
+	if (g_mpd == *current) return;
+
+	g_mpd.version++;
+	g_snapshot.store(std::make_shared<const MPDState>(g_mpd), std::memory_order_release);
+	LOG_DEBUG("MPD state version " << g_mpd.version);
+}
+
+void fetchMPDInfo() {
+	pollMPDState();
+	publishMPDState();
+}
+
+std::shared_ptr<const MPDState> getMPDState() {
+	return g_snapshot.load(std::memory_order_acquire);
+}
+
+static unsigned toMPDEvents(unsigned idle) {
+	unsigned events = MPD_EVENT_NONE;
+	if (idle & MPD_IDLE_PLAYER)   events |= MPD_EVENT_PLAYER;
+	if (idle & MPD_IDLE_PLAYLIST) events |= MPD_EVENT_PLAYLIST;
+	if (idle & MPD_IDLE_OPTIONS)  events |= MPD_EVENT_OPTIONS;
+	return events;
+}
+
+// Handle a failed idle/noidle round trip. A server error means `idle` was
+// refused (proxy, restricted permissions) -- switch to polling for good.
+// Anything else is a broken connection and is dropped for reconnect.
+static void handleIdleError() {
+	if (mpd_connection_get_error(g_conn) == MPD_ERROR_SERVER &&
+			mpd_connection_clear_error(g_conn)) {
+		LOG_WARN("MPD rejected idle (" << mpd_connection_get_server_error(g_conn)
+				<< ") -- falling back to " << POLL_INTERVAL_MS << " ms polling");
+		g_idleSupported = false;
+		return;
+	}
+
+	LOG_ERR("MPD idle failed: " << mpd_connection_get_error_message(g_conn)
+			<< " -- dropping connection");
+	dropConnection();
+}
+
+unsigned waitMPDEvent(int timeoutMs) {
+	if (g_shutdownRequested) return MPD_EVENT_SHUTDOWN;
+	if (!g_conn) return waitReconnect(timeoutMs);
+
+	// Polling fallback: the only periodic wake-up, and only without idle
+	if (!g_idleSupported)
+		return loopEvents(event_loop_wait(-1, 0, timeoutMs < 0 ? POLL_INTERVAL_MS
+				: std::min(timeoutMs, POLL_INTERVAL_MS)));
+
+	if (!mpd_send_idle_mask(g_conn, IDLE_MASK)) {
+		handleIdleError();
+		return MPD_EVENT_TIMEOUT;
+	}
+
+	const unsigned ready = event_loop_wait(mpd_connection_get_fd(g_conn), EPOLLIN, timeoutMs);
+
+	unsigned idle = 0;
+	if (ready & LOOP_FD) {
+		idle = mpd_recv_idle(g_conn, false);
+	} else {
+		// Timer, wake-up, signal or timeout: leave idle mode so the
+		// connection is usable again. MPD may still report events that
+		// raced with noidle.
+		idle = mpd_run_noidle(g_conn);
+	}
+
+	if (idle == 0 && mpd_connection_get_error(g_conn) != MPD_ERROR_SUCCESS) {
+		handleIdleError();
+		return MPD_EVENT_TIMEOUT;
+	}
+
+	unsigned events = toMPDEvents(idle);
+	if (loopEvents(ready) == MPD_EVENT_SHUTDOWN) events |= MPD_EVENT_SHUTDOWN;
+	if (events == MPD_EVENT_NONE)                events  = MPD_EVENT_TIMEOUT;
+
+	LOG_DEBUG("MPD idle events: 0x" << std::hex << events << std::dec);
+	return events;
+}
+
+void requestMPDShutdown() {
+	g_shutdownRequested = true;
+	event_loop_wake();
+
+	const uint64_t one = 1;
+	if (g_shutdownFd >= 0) {
+		ssize_t r = write(g_shutdownFd, &one, sizeof(one));
+		(void)r;
+	}
+}
+
+// Ask MPD to decode the song and return its Chromaprint fingerprint.
+// Waits on the socket so it can give up early: when `cancelled` turns true
+// or on shutdown the connection is closed, which makes MPD stop decoding.
+// Returns nullopt on a connection failure or cancellation so the caller
+// does not memoise it. Call with g_heavyMutex held.
+static std::optional<std::string> runFingerprint(
+		const std::string& uri, const std::function<bool()>& cancelled) {
+	if (!mpd_send_getfingerprint(g_heavyConn, uri.c_str())) {
+		LOG_ERR("Error requesting fingerprint -- dropping connection");
+		dropHeavyConnection();
+		return std::nullopt;
+	}
+
+	pollfd fds[2] = {
+		{ mpd_connection_get_fd(g_heavyConn), POLLIN, 0 },
+		{ g_shutdownFd,                       POLLIN, 0 },
+	};
+
+	while (true) {
+		int r = poll(fds, 2, CANCEL_CHECK_MS);
+		if (r > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) break;
+
+		if ((r > 0 && (fds[1].revents & POLLIN)) || (cancelled && cancelled())) {
+			LOG_DEBUG("Fingerprint of " << uri << " abandoned");
+			dropHeavyConnection();
+			return std::nullopt;
+		}
+
+		if (r < 0 && errno != EINTR) {
+			LOG_ERR("poll() on MPD fingerprint connection failed: " << strerror(errno));
+			dropHeavyConnection();
+			return std::nullopt;
+		}
+	}
+
+	std::string fp;
+	if (mpd_pair* pair = mpd_recv_pair_named(g_heavyConn, "chromaprint")) {
+		fp = pair->value;
+		mpd_return_pair(g_heavyConn, pair);
+	}
+
+	if (!mpd_response_finish(g_heavyConn)) {
+		if (mpd_connection_get_error(g_heavyConn) == MPD_ERROR_SERVER &&
+				mpd_connection_clear_error(g_heavyConn)) {
+			// e.g. no decoder for this file -- remember the failure
+			LOG_ERR("Error getting fingerprint for " << uri);
+			return std::string();
+		}
+		LOG_ERR("Error getting fingerprint -- dropping connection");
+		dropHeavyConnection();
+		return std::nullopt;
+	}
+	return fp;
+}
+
+std::string getMPDCachedFingerprint(const std::string& uri) {
+	if (uri.empty()) return {};
+	auto cached = g_fingerprintCache.get(uri);
+	return cached ? std::move(*cached) : std::string();
+}
+
+std::string getMPDFingerprintFor(const std::string& uri,
+		const std::function<bool()>& cancelled) {
+	if (uri.empty()) return {};
+	if (classifyMPDUri(uri) != MPDSource::File) {
+		LOG_DEBUG("Not fingerprinting non-file URI: " << uri);
+		return {};
+	}
+
+	if (auto cached = g_fingerprintCache.get(uri)) {
+		LOG_DEBUG("Using cached fingerprint for: " << uri);
+		return std::move(*cached);
+	}
+
+	std::lock_guard<std::mutex> lock(g_heavyMutex);
+	if (!ensureHeavyConnected()) return {};
+
+	LOG_DEBUG("Computing fingerprint for: " << uri);
+	std::optional<std::string> fp = runFingerprint(uri, cancelled);
+	if (!fp) return {};
+
+	g_fingerprintCache.put(uri, *fp);
+	return *fp;
+}
+
+std::vector<MPDQueueEntry> getMPDUpcoming(unsigned count) {
+	std::vector<MPDQueueEntry> upcoming;
+	const std::shared_ptr<const MPDState> state = getMPDState();
+	if (!state->valid || state->nextSongPos < 0 || count == 0) return upcoming;
+	if (!ensureConnected()) return upcoming;
+
+	const unsigned start = static_cast<unsigned>(state->nextSongPos);
+	if (!mpd_send_list_queue_range_meta(g_conn, start, start + count)) {
+		LOG_ERR("Failed to list upcoming queue entries -- dropping connection");
+		dropConnection();
+		return upcoming;
+	}
+
+	while (mpd_song* song = mpd_recv_song(g_conn)) {
+		MPDQueueEntry e;
+		const char* v;
+
+		e.songID   = static_cast<int>(mpd_song_get_id(song));
+		e.duration = static_cast<int>(mpd_song_get_duration(song));
+
+		v = mpd_song_get_uri(song);
+		e.uri = v ? v : "";
+
+		v = mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
+		e.title = v ? v : "Unknown Title";
+
+		v = mpd_song_get_tag(song, MPD_TAG_ARTIST, 0);
+		e.artist = v ? v : "Unknown Artist";
+
+		v = mpd_song_get_tag(song, MPD_TAG_ALBUM, 0);
+		e.album = v ? v : "Unknown Album";
+
+		v = mpd_song_get_tag(song, MPD_TAG_ALBUM_ARTIST, 0);
+		e.albumArtist = v ? v : e.artist;
+
+		v = mpd_song_get_tag(song, MPD_TAG_DATE, 0);
+		e.date = v ? v : "";
+
+		v = mpd_song_get_tag(song, MPD_TAG_MUSICBRAINZ_ALBUMID, 0);
+		e.mbAlbumID = v ? v : "";
+
+		v = mpd_song_get_tag(song, MPD_TAG_MUSICBRAINZ_RELEASEGROUPID, 0);
+		e.mbReleaseGroupID = v ? v : "";
+
+		upcoming.push_back(std::move(e));
+		mpd_song_free(song);
+	}
+
+	if (!mpd_response_finish(g_conn)) {
+		if (mpd_connection_get_error(g_conn) == MPD_ERROR_SERVER &&
+				mpd_connection_clear_error(g_conn)) {
+			LOG_DEBUG("MPD refused queue range listing");
+		} else {
+			LOG_ERR("Failed to read upcoming queue entries -- dropping connection");
+			dropConnection();
+		}
+	}
+
+	return upcoming;
+}
+
+std::vector<MPDAlbum> getMPDAlbums() {
+	std::vector<MPDAlbum> albums;
+	if (!waitConnected(CONNECT_TIMEOUT_MS)) {
+		LOG_ERR("Failed to connect to MPD");
+		return albums;
+	}
+
+	if (!mpd_search_db_tags(g_conn, MPD_TAG_ALBUM) ||
+			!mpd_search_add_group_tag(g_conn, MPD_TAG_ALBUM_ARTIST) ||
+			!mpd_search_add_group_tag(g_conn, MPD_TAG_DATE) ||
+			!mpd_search_commit(g_conn)) {
+		LOG_ERR("Failed to list MPD albums: " << mpd_connection_get_error_message(g_conn));
+		mpd_search_cancel(g_conn);
+		dropConnection();
+		return albums;
+	}
+
+	// Group values are only sent when they change, so carry them over
+	std::string artist, date;
+	while (mpd_pair* pair = mpd_recv_pair(g_conn)) {
+		const std::string name = pair->name;
+		if (name == "AlbumArtist")  artist = pair->value;
+		else if (name == "Date")    date   = pair->value;
+		else if (name == "Album" && *pair->value)
+			albums.push_back({artist, pair->value, date});
+		mpd_return_pair(g_conn, pair);
+	}
+
+	if (!mpd_response_finish(g_conn)) {
+		LOG_ERR("Failed to read MPD album list: " << mpd_connection_get_error_message(g_conn));
+		dropConnection();
+	}
+
+	return albums;
+}
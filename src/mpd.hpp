@@ -1,36 +1,116 @@
 #pragma once
 #include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <memory>
 
+// Where a song URI points (see classifyMPDUri)
+enum class MPDSource {
+	File,   // in the music directory (or a file:// URI)
+	Stream, // internet radio and other network streams
+	Other,  // any other input plugin (cdda://, alsa://, nfs://, ...)
+};
+
+// One observation of the player. Published as an immutable snapshot (see
+// getMPDState); `version` increases by one with every change.
 struct MPDState {
+	uint64_t version = 0;
+
 	bool valid = false;
 	bool paused = false;
 
 	std::string title;
 	std::string artist;
 	std::string album;
+	std::string albumArtist;
 	std::string date;
+	std::string mbAlbumID;   // MUSICBRAINZ_ALBUMID tag, if any
+	std::string mbReleaseGroupID; // MUSICBRAINZ_RELEASEGROUPID tag, if any
 	std::string filePath;
-	std::string fingerprint;
-	int SongID;
+	std::string uri;
+	std::string name;        // stream/station name (`Name` tag), if any
+	MPDSource   source = MPDSource::File;
+	int SongID = 0;
+	int nextSongPos = -1;
 
 	int64_t elapsed = 0;
 	int64_t total = 0;
+
+	bool operator==(const MPDState&) const = default;
+};
+
+// Subsystem changes reported by waitMPDEvent()
+enum MPDEvent : unsigned {
+	MPD_EVENT_NONE     = 0,
+	MPD_EVENT_PLAYER   = 1u << 0, // play/pause/stop/seek/track change
+	MPD_EVENT_PLAYLIST = 1u << 1, // queue modified
+	MPD_EVENT_OPTIONS  = 1u << 2, // repeat/random/single/consume
+	MPD_EVENT_TIMEOUT  = 1u << 3, // woken by something other than MPD (timeout, event loop timer or wake-up, polling mode)
+	MPD_EVENT_SHUTDOWN = 1u << 4, // requestMPDShutdown() was called or a terminating signal arrived
+};
+
+// A queue entry after the current song (see getMPDUpcoming)
+struct MPDQueueEntry {
+	int songID   = -1;
+	int duration = 0;
+
+	std::string uri;
+	std::string title;
+	std::string artist;
+	std::string album;
+	std::string albumArtist;
+	std::string date;
+	std::string mbAlbumID;
+	std::string mbReleaseGroupID;
+};
+
+// One album from the MPD database (see getMPDAlbums)
+struct MPDAlbum {
+	std::string artist; // album artist
+	std::string album;
+	std::string date;
 };
 
-// Fetch / update MPD
+// Classify a song URI by its scheme. Only files can be fingerprinted; a
+// stream would make MPD open and decode the remote station.
+MPDSource classifyMPDUri(const std::string& uri);
+
+// Fetch / update MPD. Publishes a new snapshot only if something changed.
 void fetchMPDInfo();
 
-// MPD getters
-bool getMPDIsValid();
-bool getMPDIsPaused();
+// Latest snapshot; never null. Safe from any thread, and reading copies a
+// pointer, not the state. Keep the pointer (rather than calling again) for
+// a consistent view.
+std::shared_ptr<const MPDState> getMPDState();
+
+// Block until MPD reports a change in the player, playlist or options
+// subsystems, the timeout (ms, -1 = forever) expires, or the event loop
+// reports its timer, a wake-up or a signal (see event_loop.hpp).
+// Falls back to a fixed 250 ms poll when the server rejects `idle`.
+// Returns a mask of MPDEvent flags.
+unsigned waitMPDEvent(int timeoutMs);
+
+// Make waitMPDEvent() return MPD_EVENT_SHUTDOWN from now on and abort a
+// running fingerprint. Async-signal-safe.
+void requestMPDShutdown();
+
+// Chromaprint fingerprint of a song. Computed on first request (MPD decodes
+// the file server-side, which can take seconds) and memoised per URI.
+// Runs on a dedicated MPD connection, so status/idle on the main connection
+// is never held up; safe to call from any thread. The decode is abandoned
+// (and "" returned) once `cancelled` returns true or shutdown is requested.
+// Returns "" without asking MPD for anything but local files.
+std::string getMPDFingerprintFor(const std::string& uri,
+		const std::function<bool()>& cancelled = {});
+
+// Memoised fingerprint only ("" if not computed yet); never blocks
+std::string getMPDCachedFingerprint(const std::string& uri);
 
-std::string getMPDTitle();
-std::string getMPDArtist();
-std::string getMPDAlbum();
-std::string getMPDDate();
-std::string getMPDFilePath();
-std::string getMPDFingerprint();
-int getMPDSongID();
+// Up to `count` queue entries starting at the song MPD will play next.
+// In random mode only the first one is a reliable prediction.
+std::vector<MPDQueueEntry> getMPDUpcoming(unsigned count);
 
-int64_t getMPDElapsed();
-int64_t getMPDTotal();
+// Every distinct (album artist, album, date) in the MPD database,
+// via `list album group albumartist group date`.
+std::vector<MPDAlbum> getMPDAlbums();
@@ -0,0 +1,165 @@
+#include "prewarm.hpp"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "album_art.hpp"
+#include "http_client.hpp"
+#include "art_cache.hpp"
+#include "mpd.hpp"
+#include "logger.hpp"
+
+namespace {
+
+	using Clock = std::chrono::steady_clock;
+
+	// How often progress is reported
+	constexpr auto PROGRESS_INTERVAL = std::chrono::seconds(10);
+
+	// Albums resolved at once. The HTTP scheduler still allows only one
+	// MusicBrainz search per second; the extra workers overlap one album's
+	// Cover Art Archive checks with the next album's search.
+	constexpr unsigned PREWARM_WORKERS = 3;
+
+	bool is_known(const std::string& value, const char* unknown) {
+		return !value.empty() && value != unknown;
+	}
+
+} // anonymous namespace
+
+int run_prewarm(const std::atomic<bool>& keepRunning) {
+	const std::string dir = art_cache_directory();
+	if (dir.empty()) {
+		LOG_ERR("Prewarm needs a cache directory (XDG_CACHE_HOME or HOME)");
+		return 1;
+	}
+	const std::filesystem::path progressPath = std::filesystem::path(dir) / "prewarm.progress";
+
+	LOG_INFO("Prewarm: listing albums from MPD");
+	std::vector<MPDAlbum> albums = getMPDAlbums();
+	if (albums.empty()) {
+		LOG_ERR("Prewarm: MPD returned no albums");
+		return 1;
+	}
+
+	// Albums finished by an earlier, interrupted run
+	std::unordered_set<std::string> done;
+	{
+		std::ifstream in(progressPath);
+		std::string key;
+		while (std::getline(in, key)) done.insert(key);
+	}
+	if (!done.empty())
+		LOG_INFO("Prewarm: resuming, " << done.size() << " albums already done");
+
+	std::ofstream progress(progressPath, std::ios::app);
+
+	// Deduplicate (different dates of an album stay separate releases)
+	struct Todo {
+		const MPDAlbum* album;
+		std::string     key;
+	};
+	std::vector<Todo> todo;
+	std::unordered_set<std::string> seen;
+	size_t total = 0;
+	for (const auto& a : albums) {
+		std::string key = art_cache_album_key(a.artist, a.album, a.date);
+		if (!seen.insert(key).second) continue;
+		total++;
+		if (!done.count(key)) todo.push_back({&a, std::move(key)});
+	}
+	seen.clear();
+
+	LOG_INFO("Prewarm: " << total << " albums to check");
+
+	std::atomic<size_t> next{0}, processed{total - todo.size()};
+	std::atomic<size_t> found{0}, cached{0}, skipped{0}, lookups{0}, failed{0};
+	std::mutex progressMutex;
+	std::atomic<bool> cancel{false}; // aborts in-flight requests on shutdown
+
+	auto work = [&] {
+		// Bulk priority; the scheduler keeps us inside the upstream rate limits
+		HttpRequestScope scope(HttpPriority::Bulk, {}, &cancel);
+
+		while (keepRunning) {
+			const size_t i = next++;
+			if (i >= todo.size()) break;
+			const MPDAlbum& a = *todo[i].album;
+			const std::string& key = todo[i].key;
+
+			// Settled albums are checkpointed. A lookup that failed on a
+			// network error, throttling or cancellation stores nothing,
+			// so it is left for the next run.
+			bool settled = true;
+			if (!is_known(a.artist, "Unknown Artist") || !is_known(a.album, "Unknown Album") ||
+					a.date.empty()) {
+				skipped++;
+			} else if (auto hit = art_cache_get(key); hit && !hit->stale) {
+				cached++;
+			} else {
+				lookups++;
+				AlbumUrls urls = get_album_urls_search(a.artist, a.album, a.date, 100);
+				if (!urls.cover_url.empty()) found++;
+				auto stored = art_cache_get(key);
+				settled = stored && !stored->stale;
+				if (!settled) failed++;
+			}
+			processed++;
+
+			if (settled) {
+				std::lock_guard<std::mutex> lock(progressMutex);
+				progress << key << '\n' << std::flush;
+			}
+		}
+	};
+
+	const auto started = Clock::now();
+	std::vector<std::thread> workers;
+	const size_t workerCount = std::min<size_t>(PREWARM_WORKERS, todo.size());
+	for (size_t i = 0; i < workerCount; ++i) workers.emplace_back(work);
+
+	auto lastReport = started;
+	while (processed < total && keepRunning) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		const auto now = Clock::now();
+		if (now - lastReport >= PROGRESS_INTERVAL) {
+			lastReport = now;
+			const double minutes = std::chrono::duration<double>(now - started).count() / 60.0;
+			const double rate = minutes > 0 ? lookups / minutes : 0.0;
+			LOG_INFO("Prewarm: " << processed << "/" << total << " albums, "
+					<< found << " found, " << cached << " already cached, "
+					<< skipped << " skipped (missing tags), " << failed << " failed, "
+					<< static_cast<int>(rate) << " lookups/min");
+		}
+	}
+	cancel = !keepRunning;
+	for (auto& t : workers) t.join();
+
+	const double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+	LOG_INFO("Prewarm: " << processed << "/" << total << " albums in "
+			<< static_cast<int>(seconds) << "s -- " << found << " found, "
+			<< cached << " already cached, " << skipped << " skipped, "
+			<< failed << " failed");
+
+	if (processed < total || !keepRunning) {
+		LOG_INFO("Prewarm interrupted; run --prewarm again to resume");
+		return 0;
+	}
+	if (failed > 0) {
+		LOG_INFO("Prewarm: " << failed << " lookups failed (network errors or throttling); "
+				"run --prewarm again to retry them");
+		return 0;
+	}
+
+	// Finished: the next run starts from scratch (refreshing expired entries)
+	progress.close();
+	std::error_code ec;
+	std::filesystem::remove(progressPath, ec);
+	return 0;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <atomic>
+
+// --prewarm: resolve album art for every album in the MPD database into the
+// persistent cache. Runs until done or `keepRunning` is cleared; finished
+// albums are checkpointed so an interrupted run resumes where it stopped.
+// Returns the process exit code.
+int run_prewarm(const std::atomic<bool>& keepRunning);
@@ -0,0 +1,137 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+/**
+ * Bounded, lock-free FIFO between pipeline stages (Vyukov's MPMC ring).
+ *
+ * Each slot carries a sequence number telling producers and consumers
+ * whose turn it is, so any number of threads may push and pop without a
+ * lock. Since any thread may pop, a producer can also evict the oldest
+ * entry itself when the consumer falls behind (push_drop_oldest()).
+ *
+ * T must be default-constructible and move-assignable.
+ **/
+template <typename T>
+class RingQueue {
+	public:
+		struct Stats {
+			size_t   depth     = 0; // entries queued right now (approximate)
+			size_t   peak      = 0; // highest depth seen
+			uint64_t pushed    = 0;
+			uint64_t dropped   = 0; // evicted by push_drop_oldest()
+		};
+
+		/** @param capacity  Rounded up to a power of two (at least 2). **/
+		explicit RingQueue(size_t capacity)
+			: capacity_(std::bit_ceil(std::max<size_t>(2, capacity))),
+			  mask_(capacity_ - 1),
+			  cells_(std::make_unique<Cell[]>(capacity_)) {
+			for (size_t i = 0; i < capacity_; ++i)
+				cells_[i].seq.store(i, std::memory_order_relaxed);
+		}
+
+		RingQueue(const RingQueue&) = delete;
+		RingQueue& operator=(const RingQueue&) = delete;
+
+		/** Append `value` (moved from only on success). False when full. **/
+		bool try_push(T&& value) {
+			size_t pos = enqueue_.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &cells_[pos & mask_];
+				const size_t seq = cell->seq.load(std::memory_order_acquire);
+				const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+				if (dif == 0) {
+					if (enqueue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				} else if (dif < 0) {
+					return false;
+				} else {
+					pos = enqueue_.load(std::memory_order_relaxed);
+				}
+			}
+			cell->value = std::move(value);
+			cell->seq.store(pos + 1, std::memory_order_release);
+
+			pushed_.fetch_add(1, std::memory_order_relaxed);
+			const size_t depth = this->depth();
+			size_t peak = peak_.load(std::memory_order_relaxed);
+			while (depth > peak &&
+					!peak_.compare_exchange_weak(peak, depth, std::memory_order_relaxed)) {}
+			return true;
+		}
+
+		/**
+		 * Append `value`, evicting the oldest entries while the queue is full.
+		 * For queues where a newer entry supersedes older ones.
+		 **/
+		void push_drop_oldest(T value) {
+			while (!try_push(std::move(value))) {
+				if (try_pop()) dropped_.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+
+		/** Remove and return the oldest entry, if any. **/
+		std::optional<T> try_pop() {
+			size_t pos = dequeue_.load(std::memory_order_relaxed);
+			Cell* cell;
+			while (true) {
+				cell = &cells_[pos & mask_];
+				const size_t seq = cell->seq.load(std::memory_order_acquire);
+				const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+				if (dif == 0) {
+					if (dequeue_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+						break;
+				} else if (dif < 0) {
+					return std::nullopt;
+				} else {
+					pos = dequeue_.load(std::memory_order_relaxed);
+				}
+			}
+			std::optional<T> value(std::move(cell->value));
+			cell->value = T{}; // release what the entry held now, not on reuse
+			cell->seq.store(pos + capacity_, std::memory_order_release);
+			return value;
+		}
+
+		/** Number of queued entries; exact only when no push/pop is running. **/
+		size_t depth() const {
+			const size_t in  = enqueue_.load(std::memory_order_relaxed);
+			const size_t out = dequeue_.load(std::memory_order_relaxed);
+			return in > out ? in - out : 0;
+		}
+
+		Stats stats() const {
+			Stats st;
+			st.depth   = depth();
+			st.peak    = peak_.load(std::memory_order_relaxed);
+			st.pushed  = pushed_.load(std::memory_order_relaxed);
+			st.dropped = dropped_.load(std::memory_order_relaxed);
+			return st;
+		}
+
+	private:
+		struct Cell {
+			std::atomic<size_t> seq{0};
+			T                   value{};
+		};
+
+		const size_t            capacity_;
+		const size_t            mask_;
+		std::unique_ptr<Cell[]> cells_;
+
+		// Producers and consumers each get their own cache line
+		alignas(64) std::atomic<size_t> enqueue_{0};
+		alignas(64) std::atomic<size_t> dequeue_{0};
+
+		std::atomic<size_t>   peak_{0};
+		std::atomic<uint64_t> pushed_{0};
+		std::atomic<uint64_t> dropped_{0};
+};
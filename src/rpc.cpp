@@ -2,7 +2,7 @@
 #include <discord-rpc.hpp>
 #include <iostream>
 #include <string>
-#include <mutex>
+#include <atomic>
 #include "logger.hpp"
 #include "config.hpp"
 
@@ -19,8 +19,10 @@ static std::string Button1Url;
 static std::string Button2Label;
 static std::string Button2Url;
 
-// Single mutex protecting ALL RPC state including reads in updatePresence()
-static std::mutex rpcMutex;
+// All presence state above is owned by the main thread, the pipeline's
+// publisher stage: art found by the resolver arrives through
+// art_resolver_take_result() instead of being written from the worker, so
+// none of it needs a lock.
 
 static void discordSetup() {
 	LOG_DEBUG("Setting up Discord RPC");
@@ -38,8 +40,7 @@ static void discordSetup() {
 			});
 }
 
-// Must be called with rpcMutex held
-static void updatePresenceLocked() {
+static void updatePresence() {
 	auto& rpc = discord::RPCManager::get();
 
 	auto& presence = rpc.getPresence()
@@ -62,18 +63,19 @@ static void updatePresenceLocked() {
 }
 
 // Song ID of the track currently shown in Discord.
-// Set by the main thread on every track change; read by art threads.
+// Set by the main thread on every track change; the art resolver worker
+// reads it to abandon lookups for a song that is no longer playing.
 static std::atomic<int> g_rpcSongID{-1};
 
 // Discord silently drops presence updates faster than ~15 seconds apart.
 // We enforce our own gate: if a push is attempted within the window, we mark
-// it as pending. The main loop checks for a pending update each tick and
-// re-sends it once the window has elapsed.
+// it as pending. The main loop arms its timer from
+// rpc_pending_flush_delay_ms() and re-sends the update once the window
+// has elapsed. Only the main thread touches this state.
 static constexpr int64_t DISCORD_RATE_LIMIT_SECONDS = 16; // 1s margin over Discord's 16s
 static int64_t  g_lastPushTime   = 0;   // wall-clock of last actual push
 static bool     g_pendingUpdate  = false; // an update was suppressed and needs retry
 
-// Must be called with rpcMutex held.
 // Returns true if the update was sent, false if rate-limited (pending flagged).
 static bool pushPresenceOrDefer() {
 	int64_t now = static_cast<int64_t>(
@@ -88,7 +90,7 @@ static bool pushPresenceOrDefer() {
 		return false;
 	}
 
-	updatePresenceLocked();
+	updatePresence();
 	g_lastPushTime  = now;
 	g_pendingUpdate = false;
 	return true;
@@ -100,9 +102,9 @@ void rpc_setup()      { discordSetup(); }
 void rpc_initialize() { discord::RPCManager::get().initialize(); }
 void rpc_shutdown()   { discord::RPCManager::get().shutdown(); }
 
-// Set all track metadata and record the song ID in one locked operation.
-// Must be called by the main thread before launching the art thread so that
-// g_rpcSongID is always up-to-date before any art thread checks it.
+// Set all track metadata and record the song ID.
+// Must be called before the track's art job is submitted so that
+// g_rpcSongID is always up-to-date before the art worker checks it.
 void rpc_set_current_song(int songID,
 		const std::string& details,
 		const std::string& state,
@@ -110,7 +112,6 @@ void rpc_set_current_song(int songID,
 		int64_t startTime,
 		int64_t endTime)
 {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	g_rpcSongID.store(songID);
 	currentDetails   = details;
 	currentState     = state;
@@ -122,90 +123,77 @@ void rpc_set_current_song(int songID,
 }
 
 void rpc_clear_presence() {
-	std::lock_guard<std::mutex> lock(rpcMutex);
+	g_rpcSongID.store(-1);   // any in-flight art lookup is now stale
 	discord::RPCManager::get().clearPresence();
 	g_pendingUpdate = false;
 	LOG_DEBUG("Discord presence cleared");
 }
 
 void rpc_update_presence() {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	LOG_DEBUG("Updating Discord presence");
 	pushPresenceOrDefer();
 }
 
 void rpc_set_starttime(int64_t v) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	StartTime = v;
 	LOG_DEBUG("StartTime = " << v);
 }
 
 void rpc_set_endtime(int64_t v) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	EndTime = v;
 	LOG_DEBUG("EndTime = " << v);
 }
 
 void rpc_set_details(const char* v) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	currentDetails = v;
 	LOG_DEBUG("Details = " << v);
 }
 
 void rpc_set_state(const char* v) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	currentState = v;
 	LOG_DEBUG("State = " << v);
 }
 
 void rpc_set_largeimagetext(const char* v) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	currentImageText = v;
 	LOG_DEBUG("LargeImageText = " << v);
 }
 
 void rpc_set_largeimage(const std::string& v) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	LargeImageKey = v;
 	LOG_DEBUG("LargeImage = " << v);
 }
 
 void rpc_set_button1(const std::string& label, const std::string& url) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	Button1Label = label;
 	Button1Url   = url;
 	LOG_DEBUG("Button1 = " << label << " (" << url << ")");
 }
 
 void rpc_set_button2(const std::string& label, const std::string& url) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	Button2Label = label;
 	Button2Url   = url;
 	LOG_DEBUG("Button2 = " << label << " (" << url << ")");
 }
 
-std::string rpc_get_details()       { std::lock_guard<std::mutex> l(rpcMutex); return currentDetails; }
-std::string rpc_get_state()         { std::lock_guard<std::mutex> l(rpcMutex); return currentState; }
-std::string rpc_get_largeimagetext(){ std::lock_guard<std::mutex> l(rpcMutex); return currentImageText; }
-std::string rpc_get_largeimage()    { std::lock_guard<std::mutex> l(rpcMutex); return LargeImageKey; }
+std::string rpc_get_details()       { return currentDetails; }
+std::string rpc_get_state()         { return currentState; }
+std::string rpc_get_largeimagetext(){ return currentImageText; }
+std::string rpc_get_largeimage()    { return LargeImageKey; }
 
-// Atomically: check song ID is still current, apply art, push to Discord.
-// Holding the mutex for the entire operation means two art threads can never
-// interleave their writes — whichever acquires the lock first either applies
-// its result (if still current) or bails out (if already superseded).
 // Returns the current song ID (for stale checks in the art thread)
 int rpc_get_current_song_id() {
 	return g_rpcSongID.load();
 }
 
+// Check the song ID is still current, apply art, push to Discord. Results
+// for a superseded song are dropped here.
 bool rpc_apply_art_if_current(int songID,
 		const std::string& cover_url,
+		const std::string& page_url,
 		const std::string& btn1_label,
-		const std::string& btn1_url,
-		int64_t startTime,
-		int64_t endTime)
+		const std::string& btn1_url)
 {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 
 	if (g_rpcSongID.load() != songID) {
 		LOG_DEBUG("rpc_apply_art_if_current: songID mismatch ("
@@ -215,7 +203,7 @@ bool rpc_apply_art_if_current(int songID,
 
 	if (!cover_url.empty()) {
 		LargeImageKey = cover_url;
-		LOG_DEBUG("Applied cover art: " << cover_url);
+		LOG_DEBUG("Applied cover art: " << cover_url << " (page: " << page_url << ")");
 	} else {
 		LargeImageKey = "mpd";
 	}
@@ -225,18 +213,15 @@ bool rpc_apply_art_if_current(int songID,
 		Button1Url   = btn1_url;
 	}
 
-	StartTime = startTime;
-	EndTime   = endTime;
-
 	pushPresenceOrDefer();
 	return true;
 }
 
-// Called by the main loop every tick: if a previous update was rate-limited
-// and the window has now expired, re-send the current presence state.
+// Called by the main loop on every wake-up (its timer fires when the window
+// ends): if a previous update was rate-limited and the window has now
+// expired, re-send the current presence state.
 // The timestamps are recalculated fresh so the timer is always accurate.
 bool rpc_flush_if_pending(int64_t newStartTime, int64_t newEndTime) {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	if (!g_pendingUpdate) return false;
 
 	int64_t now = static_cast<int64_t>(
@@ -249,15 +234,25 @@ bool rpc_flush_if_pending(int64_t newStartTime, int64_t newEndTime) {
 	StartTime = newStartTime;
 	EndTime   = newEndTime;
 
-	updatePresenceLocked();
+	updatePresence();
 	g_lastPushTime  = now;
 	g_pendingUpdate = false;
 	LOG_DEBUG("Flushed pending presence update");
 	return true;
 }
 
+int rpc_pending_flush_delay_ms() {
+	if (!g_pendingUpdate) return -1;
+
+	int64_t now = static_cast<int64_t>(
+			std::chrono::duration_cast<std::chrono::seconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count());
+
+	const int64_t remaining = DISCORD_RATE_LIMIT_SECONDS - (now - g_lastPushTime);
+	return remaining > 0 ? static_cast<int>(remaining * 1000) : 0;
+}
+
 void rpc_load_button_settings() {
-	std::lock_guard<std::mutex> lock(rpcMutex);
 	std::string l1 = g_config.getButton1Label();
 	std::string u1 = g_config.getButton1Url();
 	std::string l2 = g_config.getButton2Label();
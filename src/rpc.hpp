@@ -10,7 +10,7 @@ void rpc_shutdown();
 // Update presence manually
 void rpc_update_presence();
 
-// Set all track metadata atomically (call once per track change)
+// Set all track metadata (call once per track change)
 void rpc_set_current_song(int songID,
 		const std::string& details,
 		const std::string& state,
@@ -37,14 +37,18 @@ void rpc_clear_presence();
 // Pass fresh timestamps so the timer stays accurate. Returns true if flushed.
 bool rpc_flush_if_pending(int64_t newStartTime, int64_t newEndTime);
 
+// Milliseconds until rpc_flush_if_pending() can send the waiting update
+// (0 = now), or -1 if nothing is waiting.
+int rpc_pending_flush_delay_ms();
+
 // Returns the current song ID — for stale checks inside the art thread.
 int rpc_get_current_song_id();
 
-// Atomically apply art + timestamps + push. No-op (returns false) if song changed.
+// Apply art + button and push. No-op (returns false) if the song
+// changed in the meantime. Timestamps are left alone: they belong to the
+// main thread, which may have seen a pause/seek while art was resolving.
 bool rpc_apply_art_if_current(int songID,
 		const std::string& cover_url,
 		const std::string& page_url,
 		const std::string& btn1_label,
-		const std::string& btn1_url,
-		int64_t startTime,
-		int64_t endTime);
+		const std::string& btn1_url);
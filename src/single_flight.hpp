@@ -0,0 +1,81 @@
+#pragma once
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * Request coalescing ("single flight") keyed by string.
+ *
+ * While one caller is computing the value for a key, every other caller for
+ * the same key waits for and shares that result instead of repeating the
+ * work. Nothing is remembered once the flight lands -- caching is the
+ * caller's job.
+ **/
+template <typename V>
+class SingleFlight {
+	public:
+		/**
+		 * Run fn() for `key`, or wait for the call already in flight.
+		 * Exceptions thrown by the leader are rethrown in every waiter.
+		 **/
+		template <typename F>
+		V run(const std::string& key, F&& fn) {
+			if (auto pending = join(key)) return pending->get();
+			try {
+				V value = fn();
+				finish(key, value);
+				return value;
+			} catch (...) {
+				fail(key, std::current_exception());
+				throw;
+			}
+		}
+
+		/**
+		 * Lower-level API for callers that drive many flights at once.
+		 * Returns the result to wait on if `key` is already in flight;
+		 * otherwise the caller becomes the leader (nullopt) and must call
+		 * finish() or fail() exactly once.
+		 **/
+		std::optional<std::shared_future<V>> join(const std::string& key) {
+			std::lock_guard<std::mutex> lock(mu_);
+			auto it = flights_.find(key);
+			if (it != flights_.end()) return it->second.future;
+
+			Flight& f = flights_[key];
+			f.future = f.promise.get_future().share();
+			return std::nullopt;
+		}
+
+		/** Publish the leader's result to all waiters. **/
+		void finish(const std::string& key, V value) {
+			if (auto p = take(key)) p->set_value(std::move(value));
+		}
+
+		/** Publish the leader's failure to all waiters. **/
+		void fail(const std::string& key, std::exception_ptr e) {
+			if (auto p = take(key)) p->set_exception(std::move(e));
+		}
+
+	private:
+		struct Flight {
+			std::promise<V>       promise;
+			std::shared_future<V> future;
+		};
+
+		std::optional<std::promise<V>> take(const std::string& key) {
+			std::lock_guard<std::mutex> lock(mu_);
+			auto it = flights_.find(key);
+			if (it == flights_.end()) return std::nullopt;
+			std::promise<V> p = std::move(it->second.promise);
+			flights_.erase(it);
+			return p;
+		}
+
+		std::mutex                              mu_;
+		std::unordered_map<std::string, Flight> flights_;
+};